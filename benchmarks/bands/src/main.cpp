@@ -0,0 +1,110 @@
+// Headless banded decode benchmark for ofxFFmpeg::Player.
+//
+// Steps a paused player through a very wide file as fast as its decoder delivers frames, with decodeBands set to 1, 2,
+// 4, ... up to the number of cores, and reports the frames per second and speedup of each. Without --input it encodes
+// a test file first (7680x2160 at 30 fps, 20 seconds), which needs libx264.
+//
+// Usage: bands [--input <file>] [--ffmpeg <path>] [--ffprobe <path>] [--frames <count>] [--out <results.json>]
+
+#include "ofMain.h"
+#include "ofxFFmpeg.h"
+
+using namespace ofxFFmpeg;
+
+std::string createTestFile( const std::string &ffmpegPath )
+{
+	const std::string path = ofToDataPath( "bands-test.mp4", true );
+	if ( ofFile::doesFileExist( path, false ) ) return path;
+
+	ofLogNotice( "benchmark" ) << "Encoding " << path << "...";
+	const std::string cmd = ffmpegPath +
+	                        " -y -v error -f lavfi -i testsrc2=size=7680x2160:rate=30 -t 20"
+	                        " -c:v libx264 -preset ultrafast -g 30 -pix_fmt yuv420p \"" +
+	                        path + "\"";
+	return std::system( cmd.c_str() ) == 0 ? path : "";
+}
+
+ofJson runBenchmark( const std::string &inputPath, const PlayerSettings &settings, size_t nFrames, float baseline )
+{
+	Player player;
+	player.setup( settings );
+	if ( !player.load( inputPath ) ) {
+		return { { "bands", settings.decodeBands }, { "error", "unable to load " + inputPath } };
+	}
+	player.setLoopState( OF_LOOP_NONE );
+	nFrames = std::min( nFrames, size_t( player.getTotalNumFrames() ) );
+
+	// the first frame includes starting ffmpeg, it's timed on its own
+	const TimePoint begin = Clock::now();
+	TimePoint firstFrameTime;
+	size_t nShown = 0;
+	while ( nShown < nFrames && Clock::now() - begin < std::chrono::seconds( 120 ) ) {
+		player.update();
+		if ( !player.isFrameNew() ) {
+			std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+			continue;
+		}
+		if ( nShown++ == 0 ) firstFrameTime = Clock::now();
+		player.nextFrame();
+	}
+
+	const float elapsed = nShown > 1 ? Seconds( Clock::now() - firstFrameTime ).count() : 0.f;
+	const float fps     = elapsed > 0.f ? ( nShown - 1 ) / elapsed : 0.f;
+	return {
+	    { "bands", settings.decodeBands },
+	    { "frames", nShown },
+	    { "firstFrameTime", Seconds( firstFrameTime - begin ).count() },
+	    { "framesPerSecond", fps },
+	    { "speedup", fps > 0.f && baseline > 0.f ? fps / baseline : 1.f },
+	    { "decoderSpawns", player.getStats().decoderSpawns },
+	};
+}
+
+int main( int argc, char **argv )
+{
+	std::string inputPath   = "";
+	std::string ffmpegPath  = "ffmpeg";
+	std::string ffprobePath = "ffprobe";
+	std::string outputPath  = "bands.json";
+	size_t nFrames          = 300;
+
+	for ( int i = 1; i + 1 < argc; i += 2 ) {
+		const std::string arg = argv[i];
+		if ( arg == "--input" ) inputPath = argv[i + 1];
+		else if ( arg == "--ffmpeg" ) ffmpegPath = argv[i + 1];
+		else if ( arg == "--ffprobe" ) ffprobePath = argv[i + 1];
+		else if ( arg == "--frames" ) nFrames = ofToInt( argv[i + 1] );
+		else if ( arg == "--out" ) outputPath = argv[i + 1];
+	}
+
+	ofSetLogLevel( "ofxFFmpeg", OF_LOG_WARNING );
+
+	if ( inputPath.empty() ) inputPath = createTestFile( ffmpegPath );
+	if ( inputPath.empty() ) {
+		ofLogError( "benchmark" ) << "Unable to create a test file, pass one with --input";
+		return 1;
+	}
+
+	const size_t nCores = std::max( 1u, std::thread::hardware_concurrency() );
+
+	ofJson results = ofJson::array();
+	float baseline = 0.f;
+	for ( size_t nBands = 1;; nBands = std::min( nBands * 2, nCores ) ) {
+		PlayerSettings settings;
+		settings.ffmpegPath       = ffmpegPath;
+		settings.ffprobePath      = ffprobePath;
+		settings.useKeyframeIndex = false;  // playback from the start doesn't seek
+		settings.decodeBands      = nBands;
+
+		ofLogNotice( "benchmark" ) << "Running " << nBands << " bands...";
+		results.push_back( runBenchmark( inputPath, settings, nFrames, baseline ) );
+		if ( nBands == 1 ) baseline = results.back().value( "framesPerSecond", 0.f );
+		if ( nBands == nCores ) break;
+	}
+
+	ofJson output = { { "benchmark", "bands" }, { "input", inputPath }, { "cores", nCores }, { "results", results } };
+	std::cout << output.dump( 2 ) << std::endl;
+	ofSaveJson( outputPath, output );
+
+	return 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+// Process resource helpers shared by the benchmark and soak apps.
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined( _WIN32 )
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <dirent.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <fstream>
+#endif
+
+namespace ofxFFmpegBenchmark {
+
+struct ProcessUsage
+{
+	double cpuSeconds     = 0.;  // user + system time of the whole process
+	uint64_t rssBytes     = 0;  // resident set size
+	uint64_t peakRssBytes = 0;  // high water mark since start (or since resetPeakRss() on linux)
+	int openFiles         = -1;  // open file descriptors / handles, -1 if unknown
+	int threads           = -1;  // -1 if unknown
+};
+
+#if defined( __linux__ )
+inline uint64_t readProcStatusKb( const std::string& key )
+{
+	std::ifstream status( "/proc/self/status" );
+	std::string line;
+	while ( std::getline( status, line ) ) {
+		if ( line.compare( 0, key.size(), key ) == 0 ) return std::stoull( line.substr( key.size() + 1 ) );
+	}
+	return 0;
+}
+
+inline int countDirEntries( const std::string& path )
+{
+	int count = 0;
+	if ( auto dir = opendir( path.c_str() ) ) {
+		while ( auto entry = readdir( dir ) ) {
+			if ( entry->d_name[0] != '.' ) ++count;
+		}
+		closedir( dir );
+	}
+	return count;
+}
+#endif
+
+inline ProcessUsage getProcessUsage()
+{
+	ProcessUsage usage;
+
+#if defined( _WIN32 )
+	FILETIME creation, exit, kernel, user;
+	if ( GetProcessTimes( GetCurrentProcess(), &creation, &exit, &kernel, &user ) ) {
+		auto toSeconds   = []( const FILETIME& t ) { return ( ( uint64_t( t.dwHighDateTime ) << 32 ) | t.dwLowDateTime ) * 1e-7; };
+		usage.cpuSeconds = toSeconds( kernel ) + toSeconds( user );
+	}
+	PROCESS_MEMORY_COUNTERS memory;
+	if ( GetProcessMemoryInfo( GetCurrentProcess(), &memory, sizeof( memory ) ) ) {
+		usage.rssBytes     = memory.WorkingSetSize;
+		usage.peakRssBytes = memory.PeakWorkingSetSize;
+	}
+	DWORD handles = 0;
+	if ( GetProcessHandleCount( GetCurrentProcess(), &handles ) ) usage.openFiles = int( handles );
+#else
+	rusage ru;
+	if ( getrusage( RUSAGE_SELF, &ru ) == 0 ) {
+		usage.cpuSeconds = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+#if defined( __APPLE__ )
+		usage.peakRssBytes = ru.ru_maxrss;  // bytes on macOS
+#else
+		usage.peakRssBytes = uint64_t( ru.ru_maxrss ) * 1024;  // kilobytes on linux
+#endif
+	}
+#if defined( __linux__ )
+	usage.rssBytes     = readProcStatusKb( "VmRSS" ) * 1024;
+	usage.peakRssBytes = readProcStatusKb( "VmHWM" ) * 1024;
+	usage.threads      = int( readProcStatusKb( "Threads" ) );
+	usage.openFiles    = countDirEntries( "/proc/self/fd" ) - 1;  // minus the fd used to list the directory
+#endif
+#endif
+
+	return usage;
+}
+
+// resets the peak RSS high water mark, so peaks can be measured per run (linux only, no-op elsewhere)
+inline void resetPeakRss()
+{
+#if defined( __linux__ )
+	std::ofstream( "/proc/self/clear_refs" ) << "5";
+#endif
+}
+
+}  // namespace ofxFFmpegBenchmark
@@ -0,0 +1,212 @@
+// Microbenchmarks for the recorder's frame queue and frame copy paths.
+//
+//  - queue: produce/consume throughput and latency of LockFreeQueue and RingBuffer,
+//    with producer and consumer unpinned, pinned to the same core, or pinned to different cores
+//  - copy: cost of the ofPixels copy and the setFromExternalPixels duplicate paths used in Recorder::addFrame(), per frame size
+//
+// Usage: micro [--items <queue items per run>] [--iterations <copies per size>] [--out <results.json>]
+
+#include "ofMain.h"
+#include "ofxFFmpeg.h"
+
+#if defined( __linux__ )
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace ofxFFmpeg;
+
+enum class Placement
+{
+	Unpinned,
+	SameCore,
+	DifferentCores
+};
+
+struct QueueItem
+{
+	TimePoint queuedTime;
+	ofPixels *pixels;
+};
+
+// pins the calling thread to a core, returns false where unsupported
+bool pinToCore( int core )
+{
+#if defined( __linux__ )
+	cpu_set_t set;
+	CPU_ZERO( &set );
+	CPU_SET( core % std::max( 1u, std::thread::hardware_concurrency() ), &set );
+	return pthread_setaffinity_np( pthread_self(), sizeof( set ), &set ) == 0;
+#else
+	return false;
+#endif
+}
+
+std::string getPlacementName( Placement placement )
+{
+	switch ( placement ) {
+		case Placement::Unpinned: return "unpinned";
+		case Placement::SameCore: return "same-core";
+		case Placement::DifferentCores: return "different-cores";
+	}
+	return "";
+}
+
+// runs one producer and one consumer thread through a queue adapter exposing push(item) / pop(item)
+template <typename Queue>
+ofJson runQueueBenchmark( const std::string &name, Queue &queue, Placement placement, size_t nItems )
+{
+	LatencyHistogram latency;
+	std::atomic<bool> ready { false };
+	bool pinned = true;
+
+	auto pin = [&]( int core ) {
+		if ( placement != Placement::Unpinned ) pinned = pinToCore( core ) && pinned;
+	};
+
+	const TimePoint begin = Clock::now();
+
+	std::thread consumer( [&] {
+		pin( placement == Placement::DifferentCores ? 1 : 0 );
+		ready = true;
+		QueueItem item;
+		for ( size_t received = 0; received < nItems; ) {
+			if ( queue.pop( item ) ) {
+				latency.add( Clock::now() - item.queuedTime );
+				++received;
+			}
+		}
+	} );
+
+	pin( 0 );
+	while ( !ready ) {}
+	for ( size_t sent = 0; sent < nItems; ) {
+		if ( queue.push( { Clock::now(), nullptr } ) ) {
+			++sent;
+		} else {
+			std::this_thread::yield();  // bounded queue is full
+		}
+	}
+	consumer.join();
+
+	const float seconds = Seconds( Clock::now() - begin ).count();
+
+	return {
+	    { "queue", name },
+	    { "placement", getPlacementName( placement ) },
+	    { "pinned", placement != Placement::Unpinned && pinned },
+	    { "items", nItems },
+	    { "itemsPerSecond", nItems / seconds },
+	    { "latencyP50", latency.getPercentile( 0.5f ).count() },
+	    { "latencyP99", latency.getPercentile( 0.99f ).count() },
+	    { "latencyMax", latency.getMax().count() },
+	};
+}
+
+struct LockFreeQueueAdapter
+{
+	LockFreeQueue<QueueItem> queue;
+	bool push( const QueueItem &item )
+	{
+		queue.produce( item );
+		return true;
+	}
+	bool pop( QueueItem &item ) { return queue.consume( item ); }
+};
+
+struct RingBufferAdapter
+{
+	RingBuffer<QueueItem> queue { 1024 };
+	bool push( const QueueItem &item ) { return queue.write( &item, 1 ) == 1; }
+	bool pop( QueueItem &item ) { return queue.read( &item, 1 ) == 1; }
+};
+
+// times fn over n iterations, returns seconds per iteration
+template <typename Fn>
+float timeIt( size_t n, Fn fn )
+{
+	const TimePoint begin = Clock::now();
+	for ( size_t i = 0; i < n; ++i ) fn( i );
+	return Seconds( Clock::now() - begin ).count() / n;
+}
+
+ofJson runCopyBenchmark( const std::string &name, glm::ivec2 resolution, size_t iterations )
+{
+	ofPixels source;
+	source.allocate( resolution.x, resolution.y, OF_PIXELS_RGB );
+	source.set( 127 );
+
+	// Recorder::addFrame() copies the frame once...
+	const float copy = timeIt( iterations, [&]( size_t ) {
+		ofPixels *pixels = new ofPixels( source );
+		delete pixels;
+	} );
+
+	// ...and references that copy for every duplicate
+	const float reference = timeIt( iterations, [&]( size_t ) {
+		ofPixels *pixels = new ofPixels();
+		pixels->setFromExternalPixels( source.getData(), source.getWidth(), source.getHeight(), source.getPixelFormat() );
+		delete pixels;
+	} );
+
+	// baseline: copy into an already allocated buffer
+	std::vector<unsigned char> target( source.getTotalBytes() );
+	const float memcpyTime = timeIt( iterations, [&]( size_t ) {
+		std::memcpy( target.data(), source.getData(), target.size() );
+	} );
+
+	return {
+	    { "size", name },
+	    { "bytes", source.getTotalBytes() },
+	    { "copySeconds", copy },
+	    { "copyBytesPerSecond", source.getTotalBytes() / copy },
+	    { "externalReferenceSeconds", reference },
+	    { "memcpySeconds", memcpyTime },
+	    { "memcpyBytesPerSecond", source.getTotalBytes() / memcpyTime },
+	};
+}
+
+int main( int argc, char **argv )
+{
+	size_t nItems          = 1000000;
+	size_t nIterations     = 50;
+	std::string outputPath = "micro.json";
+
+	for ( int i = 1; i + 1 < argc; i += 2 ) {
+		const std::string arg = argv[i];
+		if ( arg == "--items" ) nItems = ofToInt( argv[i + 1] );
+		else if ( arg == "--iterations" ) nIterations = ofToInt( argv[i + 1] );
+		else if ( arg == "--out" ) outputPath = argv[i + 1];
+	}
+
+	ofJson queueResults = ofJson::array();
+	for ( auto placement : { Placement::Unpinned, Placement::SameCore, Placement::DifferentCores } ) {
+		{
+			LockFreeQueueAdapter queue;
+			queueResults.push_back( runQueueBenchmark( "LockFreeQueue", queue, placement, nItems ) );
+		}
+		{
+			RingBufferAdapter queue;
+			queueResults.push_back( runQueueBenchmark( "RingBuffer", queue, placement, nItems ) );
+		}
+	}
+
+	const std::vector<std::pair<std::string, glm::ivec2>> sizes = {
+	    { "480p", { 640, 480 } },
+	    { "720p", { 1280, 720 } },
+	    { "1080p", { 1920, 1080 } },
+	    { "4k", { 3840, 2160 } },
+	    { "8k", { 7680, 4320 } },
+	};
+
+	ofJson copyResults = ofJson::array();
+	for ( const auto &size : sizes ) {
+		copyResults.push_back( runCopyBenchmark( size.first, size.second, nIterations ) );
+	}
+
+	ofJson output = { { "benchmark", "micro" }, { "queue", queueResults }, { "copy", copyResults } };
+	std::cout << output.dump( 2 ) << std::endl;
+	ofSaveJson( outputPath, output );
+
+	return 0;
+}
@@ -0,0 +1,98 @@
+// Headless raw capture benchmark for ofxFFmpeg::RawRecorder.
+//
+// Offers synthetic frames as fast as addFrame() takes them, at several resolutions, with and without direct io, and
+// reports the sustained write throughput, the frames captured and dropped, and write latency percentiles. Run it on the
+// disk you capture to - the throughput should reach its sequential write bandwidth.
+//
+// Usage: rawcapture [--dir <capture directory>] [--duration <seconds>] [--out <results.json>]
+
+#include "ofMain.h"
+#include "ofxFFmpeg.h"
+
+using namespace ofxFFmpeg;
+
+struct Config
+{
+	std::string name;
+	glm::ivec2 resolution;
+};
+
+ofJson runBenchmark( const Config &config, const std::string &directory, bool directIO, float duration )
+{
+	RawRecorderSettings settings;
+	settings.outputPath          = ofFilePath::join( directory, "rawcapture-" + config.name + ".raw" );
+	settings.videoResolution     = config.resolution;
+	settings.fps                 = 60.f;
+	settings.preallocateDuration = duration * settings.fps;
+	settings.directIO            = directIO;
+
+	RawRecorder recorder;
+	if ( !recorder.start( settings ) ) {
+		return { { "config", config.name }, { "error", "unable to start" } };
+	}
+
+	ofPixels pixels;
+	pixels.allocate( config.resolution.x, config.resolution.y, settings.pixelFormat );
+	pixels.set( 128 );
+
+	const TimePoint begin = Clock::now();
+	while ( Seconds( Clock::now() - begin ).count() < duration ) {
+		recorder.addFrame( pixels );
+	}
+	recorder.stop();
+	const float elapsed = Seconds( Clock::now() - begin ).count();
+
+	const RawRecorderStats stats = recorder.getStats();
+	ofFile::removeFile( settings.outputPath, false );
+	ofFile::removeFile( RawRecorder::getSidecarPath( settings.outputPath ), false );
+
+	return {
+	    { "config", config.name },
+	    { "directIO", stats.isDirectIO },
+	    { "seconds", elapsed },
+	    { "framesAdded", stats.framesAdded },
+	    { "framesDropped", stats.framesDropped },
+	    { "framesPerSecond", stats.framesAdded / elapsed },
+	    { "bytesWritten", stats.bytesWritten },
+	    { "megabytesPerSecond", stats.bytesWritten / elapsed / 1e6 },
+	    { "writeLatencyP50", stats.writeLatencyP50 },
+	    { "writeLatencyP99", stats.writeLatencyP99 },
+	    { "writeLatencyMax", stats.writeLatencyMax },
+	};
+}
+
+int main( int argc, char **argv )
+{
+	std::string directory  = ofToDataPath( "", true );
+	std::string outputPath = "rawcapture.json";
+	float duration         = 10.f;
+
+	for ( int i = 1; i + 1 < argc; i += 2 ) {
+		const std::string arg = argv[i];
+		if ( arg == "--dir" ) directory = argv[i + 1];
+		else if ( arg == "--duration" ) duration = ofToFloat( argv[i + 1] );
+		else if ( arg == "--out" ) outputPath = argv[i + 1];
+	}
+
+	ofSetLogLevel( "ofxFFmpeg", OF_LOG_WARNING );
+
+	const std::vector<Config> configs = {
+	    { "1080p", { 1920, 1080 } },
+	    { "4K", { 3840, 2160 } },
+	    { "8K", { 7680, 4320 } },
+	};
+
+	ofJson results = ofJson::array();
+	for ( const auto &config : configs ) {
+		for ( bool directIO : { true, false } ) {
+			ofLogNotice( "benchmark" ) << "Running " << config.name << ( directIO ? " (direct io)" : " (page cache)" ) << "...";
+			results.push_back( runBenchmark( config, directory, directIO, duration ) );
+		}
+	}
+
+	ofJson output = { { "benchmark", "rawcapture" }, { "directory", directory }, { "results", results } };
+	std::cout << output.dump( 2 ) << std::endl;
+	ofSaveJson( outputPath, output );
+
+	return 0;
+}
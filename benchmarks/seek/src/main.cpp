@@ -0,0 +1,164 @@
+// Headless seek latency benchmark for ofxFFmpeg::Player.
+//
+// Seeks a paused player around a long-GOP H.264 file and measures the time from setFrame() until update() shows the
+// frame, with time based seeks and with the keyframe index, for random jumps and for short scrubs forward and back.
+// Without --input it encodes a test file first (1080p30, 2 minutes, a keyframe every 10 seconds), which needs libx264.
+//
+// Usage: seek [--input <file>] [--ffmpeg <path>] [--ffprobe <path>] [--seeks <count>] [--out <results.json>]
+
+#include "ofMain.h"
+#include "ofxFFmpeg.h"
+
+#include <random>
+
+using namespace ofxFFmpeg;
+
+struct Pattern
+{
+	std::string name;
+	std::function<int( int frame, int nFrames, std::mt19937& rng )> next;  // the frame to seek to after frame
+};
+
+std::string createTestFile( const std::string &ffmpegPath )
+{
+	const std::string path = ofToDataPath( "seek-test.mp4", true );
+	if ( ofFile::doesFileExist( path, false ) ) return path;
+
+	ofLogNotice( "benchmark" ) << "Encoding " << path << "...";
+	const std::string cmd = ffmpegPath +
+	                        " -y -v error -f lavfi -i testsrc2=size=1920x1080:rate=30 -t 120"
+	                        " -c:v libx264 -preset ultrafast -g 300 -keyint_min 300 -sc_threshold 0 -bf 2 -pix_fmt yuv420p \"" +
+	                        path + "\"";
+	return std::system( cmd.c_str() ) == 0 ? path : "";
+}
+
+// seconds to build the index with ffprobe, and to load it back from the cache
+ofJson runIndexBenchmark( const std::string &inputPath, const std::string &ffprobePath )
+{
+	KeyframeIndex index;
+
+	const TimePoint buildBegin = Clock::now();
+	const bool isBuilt         = index.build( inputPath, ffprobePath );
+	const float buildTime      = Seconds( Clock::now() - buildBegin ).count();
+
+	const std::string cachePath = KeyframeIndex::getCachePath( inputPath );
+	index.save( cachePath );
+
+	const TimePoint loadBegin = Clock::now();
+	const bool isLoaded       = index.load( cachePath, inputPath );
+	const float loadTime      = Seconds( Clock::now() - loadBegin ).count();
+
+	return {
+	    { "built", isBuilt },
+	    { "buildTime", buildTime },
+	    { "loaded", isLoaded },
+	    { "loadTime", loadTime },
+	    { "frames", index.getNumFrames() },
+	    { "keyframes", index.getNumKeyframes() },
+	};
+}
+
+ofJson runBenchmark( const std::string &inputPath, const PlayerSettings &settings, const Pattern &pattern, size_t nSeeks )
+{
+	Player player;
+	player.setup( settings );
+	if ( !player.load( inputPath ) ) {
+		return { { "pattern", pattern.name }, { "error", "unable to load " + inputPath } };
+	}
+
+	// the cached index is loaded right away, give a missing one time to build
+	const TimePoint loadBegin = Clock::now();
+	while ( settings.useKeyframeIndex && !player.hasKeyframeIndex() && Clock::now() - loadBegin < std::chrono::seconds( 60 ) ) {
+		std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+	}
+
+	std::mt19937 rng( 1 );
+	const int nFrames = player.getTotalNumFrames();
+	int frame         = nFrames / 2;
+	size_t nTimeouts  = 0;
+
+	// seek like a paused editor would, waiting for each frame before moving on
+	for ( size_t i = 0; i < nSeeks; ++i ) {
+		frame = ofClamp( pattern.next( frame, nFrames, rng ), 0, nFrames - 1 );
+		player.setFrame( frame );
+
+		const TimePoint seekBegin = Clock::now();
+		do {
+			std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+			player.update();
+		} while ( !( player.isFrameNew() && player.getCurrentFrame() == frame ) && Clock::now() - seekBegin < std::chrono::seconds( 10 ) );
+
+		if ( player.getCurrentFrame() != frame || !player.isFrameNew() ) ++nTimeouts;
+	}
+
+	const PlayerStats stats = player.getStats();
+	return {
+	    { "pattern", pattern.name },
+	    { "keyframeIndex", stats.hasKeyframeIndex },
+	    { "seeks", stats.seeks },
+	    { "timeouts", nTimeouts },
+	    { "bufferedSeeks", stats.bufferedSeeks },
+	    { "forwardSeeks", stats.forwardSeeks },
+	    { "decoderSpawns", stats.decoderSpawns },
+	    { "framesDecoded", stats.framesDecoded },
+	    { "framesDiscarded", stats.framesDiscarded },
+	    { "seekLatencyP50", stats.seekLatencyP50 },
+	    { "seekLatencyP90", stats.seekLatencyP90 },
+	    { "seekLatencyP99", stats.seekLatencyP99 },
+	    { "seekLatencyMax", stats.seekLatencyMax },
+	};
+}
+
+int main( int argc, char **argv )
+{
+	std::string inputPath   = "";
+	std::string ffmpegPath  = "ffmpeg";
+	std::string ffprobePath = "ffprobe";
+	std::string outputPath  = "seek.json";
+	size_t nSeeks           = 100;
+
+	for ( int i = 1; i + 1 < argc; i += 2 ) {
+		const std::string arg = argv[i];
+		if ( arg == "--input" ) inputPath = argv[i + 1];
+		else if ( arg == "--ffmpeg" ) ffmpegPath = argv[i + 1];
+		else if ( arg == "--ffprobe" ) ffprobePath = argv[i + 1];
+		else if ( arg == "--seeks" ) nSeeks = ofToInt( argv[i + 1] );
+		else if ( arg == "--out" ) outputPath = argv[i + 1];
+	}
+
+	ofSetLogLevel( "ofxFFmpeg", OF_LOG_WARNING );
+
+	if ( inputPath.empty() ) inputPath = createTestFile( ffmpegPath );
+	if ( inputPath.empty() ) {
+		ofLogError( "benchmark" ) << "Unable to create a test file, pass one with --input";
+		return 1;
+	}
+
+	const std::vector<Pattern> patterns = {
+	    { "random", []( int, int nFrames, std::mt19937 &rng ) { return int( rng() % nFrames ); } },
+	    { "scrubForward", []( int frame, int, std::mt19937 &rng ) { return frame + 1 + int( rng() % 10 ); } },
+	    { "scrubBackward", []( int frame, int, std::mt19937 &rng ) { return frame - 1 - int( rng() % 10 ); } },
+	};
+
+	ofLogNotice( "benchmark" ) << "Running index...";
+	const ofJson indexResult = runIndexBenchmark( inputPath, ffprobePath );
+
+	ofJson results = ofJson::array();
+	for ( bool useIndex : { false, true } ) {
+		PlayerSettings settings;
+		settings.ffmpegPath       = ffmpegPath;
+		settings.ffprobePath      = ffprobePath;
+		settings.useKeyframeIndex = useIndex;
+
+		for ( const auto &pattern : patterns ) {
+			ofLogNotice( "benchmark" ) << "Running " << pattern.name << ( useIndex ? " (keyframe index)" : " (time seeks)" ) << "...";
+			results.push_back( runBenchmark( inputPath, settings, pattern, nSeeks ) );
+		}
+	}
+
+	ofJson output = { { "benchmark", "seek" }, { "input", inputPath }, { "index", indexResult }, { "results", results } };
+	std::cout << output.dump( 2 ) << std::endl;
+	ofSaveJson( outputPath, output );
+
+	return 0;
+}
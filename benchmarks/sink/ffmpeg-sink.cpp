@@ -0,0 +1,75 @@
+// A stand-in for ffmpeg, used by the benchmarks as RecorderSettings::ffmpegPath.
+// Drains stdin as fast as possible (or at --rate MB/s) and reports throughput as JSON.
+//
+// The recorder appends ffmpeg's arguments, which are ignored, except the last one (the output path),
+// where the report is written.
+//
+// Build: c++ -O2 -std=c++11 ffmpeg-sink.cpp -o ffmpeg-sink
+//
+// Usage: ffmpeg-sink [--rate <MB/s>] [ffmpeg args...] <report path>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined( _WIN32 )
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+int main( int argc, char **argv )
+{
+	double rate = 0.;  // MB/s, 0 = unthrottled
+	std::string reportPath;
+
+	for ( int i = 1; i < argc; ++i ) {
+		if ( std::strcmp( argv[i], "--rate" ) == 0 && i + 1 < argc ) {
+			rate = std::atof( argv[++i] );
+		} else if ( i == argc - 1 ) {
+			reportPath = argv[i];
+		}
+	}
+
+#if defined( _WIN32 )
+	_setmode( _fileno( stdin ), _O_BINARY );
+#endif
+
+	using Clock = std::chrono::steady_clock;
+
+	std::vector<char> buffer( 1 << 20 );
+	unsigned long long bytes = 0;
+	Clock::time_point start, end;
+
+	size_t n;
+	while ( ( n = std::fread( buffer.data(), 1, buffer.size(), stdin ) ) > 0 ) {
+		if ( bytes == 0 ) start = Clock::now();  // measure from the first byte, not from process start
+		bytes += n;
+
+		if ( rate > 0. ) {
+			// simulate a slow encoder
+			const auto due = start + std::chrono::duration<double>( bytes / ( rate * 1e6 ) );
+			std::this_thread::sleep_until( std::chrono::time_point_cast<Clock::duration>( due ) );
+		}
+	}
+	end = Clock::now();
+
+	const double seconds = bytes ? std::chrono::duration<double>( end - start ).count() : 0.;
+	const double bps     = seconds > 0. ? bytes / seconds : 0.;
+
+	char report[256];
+	std::snprintf( report, sizeof( report ), "{\"bytes\": %llu, \"seconds\": %.6f, \"bytesPerSecond\": %.1f}\n", bytes, seconds, bps );
+	std::fputs( report, stderr );
+
+	if ( !reportPath.empty() ) {
+		if ( FILE *file = std::fopen( reportPath.c_str(), "w" ) ) {
+			std::fputs( report, file );
+			std::fclose( file );
+		}
+	}
+
+	return 0;
+}
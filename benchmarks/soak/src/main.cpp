@@ -0,0 +1,238 @@
+// Soak and memory-stability harness for ofxFFmpeg::Recorder.
+//
+// 1. cycles: many short start/stop cycles (including recordings with no frames), with producers running slower
+//    than the frame rate (duplicate / pixRef path), at the frame rate, and faster (drop path).
+//    After every cycle the recorder must become ready and the open fds and thread count must return to baseline.
+// 2. continuous: one long recording with a producer rate that wanders between 0.5x and 2x the frame rate.
+//    RSS, open fds, thread count and queue depth are sampled over time; the run fails if the queue keeps growing
+//    or RSS creeps up past the allowed slope.
+//
+// Samples are written as JSON lines, the summary as JSON. Exits with 1 on failure.
+//
+// Usage: soak [--sink <path>] [--cycles <n>] [--duration <seconds of continuous recording>]
+//             [--interval <sample interval seconds>] [--max-rss-slope <MB per hour>] [--out <prefix>]
+
+#include "../../common/BenchmarkUtils.h"
+#include "ofMain.h"
+#include "ofxFFmpeg.h"
+
+#include <fstream>
+#include <random>
+
+using namespace ofxFFmpeg;
+using namespace ofxFFmpegBenchmark;
+
+struct Options
+{
+	std::string sinkPath     = "ffmpeg-sink";
+	std::string outputPrefix = "soak";
+	size_t nCycles           = 200;
+	float duration           = 600.f;
+	float sampleInterval     = 5.f;
+	float maxRssSlope        = 16.f;  // MB per hour
+	size_t maxQueuedFrames   = 0;     // 0 = two seconds of frames
+};
+
+struct Harness
+{
+	Options options;
+	RecorderSettings settings;
+	ofPixels pixels;
+	std::mt19937 rng { 1234 };
+	std::ofstream samples;
+	std::vector<std::string> failures;
+	TimePoint begin = Clock::now();
+
+	void fail( const std::string &message )
+	{
+		ofLogError( "soak" ) << message;
+		failures.push_back( message );
+	}
+
+	ofJson sample( const std::string &phase, const Recorder &recorder )
+	{
+		const ProcessUsage usage  = getProcessUsage();
+		const RecorderStats stats = recorder.getStats();
+
+		ofJson json = {
+		    { "phase", phase },
+		    { "time", Seconds( Clock::now() - begin ).count() },
+		    { "rssBytes", usage.rssBytes },
+		    { "peakRssBytes", usage.peakRssBytes },
+		    { "openFiles", usage.openFiles },
+		    { "threads", usage.threads },
+		    { "queuedFrames", stats.queuedFrames },
+		    { "queuedBytes", stats.queuedBytes },
+		    { "framesWritten", stats.framesWritten },
+		    { "framesDuplicated", stats.framesDuplicated },
+		    { "framesDropped", stats.framesDropped },
+		};
+		samples << json.dump() << std::endl;
+		return json;
+	}
+
+	// feeds frames at rateScale x the frame rate for the given time
+	void produce( Recorder &recorder, float seconds, std::function<float()> rateScale )
+	{
+		const TimePoint start = Clock::now();
+		uint64_t frame        = 0;
+
+		while ( Seconds( Clock::now() - start ).count() < seconds ) {
+			std::memset( pixels.getData(), int( frame++ & 0xff ), pixels.getTotalBytes() );
+			recorder.addFrame( pixels );
+			std::this_thread::sleep_for( Seconds( 1.f / ( settings.fps * rateScale() ) ) );
+		}
+	}
+
+	bool waitUntilReady( Recorder &recorder, float timeout = 30.f )
+	{
+		const TimePoint start = Clock::now();
+		while ( !recorder.isReady() ) {
+			if ( Seconds( Clock::now() - start ).count() > timeout ) return false;
+			std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+		}
+		return true;
+	}
+
+	void runCycles()
+	{
+		Recorder recorder;  // one recorder reused across cycles, like an app toggling recording
+		const ProcessUsage baseline = getProcessUsage();
+		std::uniform_real_distribution<float> length( 0.f, 1.5f );
+		const float rateScales[] = { 0.4f, 1.f, 2.5f };  // duplicate, steady, drop
+
+		for ( size_t i = 0; i < options.nCycles; ++i ) {
+			if ( !recorder.start( settings ) ) {
+				fail( "cycle " + ofToString( i ) + ": unable to start" );
+				return;
+			}
+
+			// every 10th cycle records nothing, to exercise stop() without a writer thread
+			if ( i % 10 != 0 ) {
+				const float rateScale = rateScales[i % 3];
+				produce( recorder, length( rng ), [=] { return rateScale; } );
+			}
+
+			recorder.stop();
+
+			if ( !waitUntilReady( recorder ) ) {
+				fail( "cycle " + ofToString( i ) + ": recorder never became ready after stop()" );
+				return;
+			}
+
+			// the writer and ffmpeg are gone once ready, give the child a moment to be reaped
+			std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+			const ProcessUsage usage = getProcessUsage();
+
+			if ( usage.openFiles > baseline.openFiles ) {
+				fail( "cycle " + ofToString( i ) + ": leaked file descriptors (" + ofToString( usage.openFiles ) + " open, baseline " + ofToString( baseline.openFiles ) + ")" );
+			}
+			if ( usage.threads > baseline.threads + 1 ) {
+				// the last writer thread is only joined by the next start(), so one extra is expected
+				fail( "cycle " + ofToString( i ) + ": leaked threads (" + ofToString( usage.threads ) + ", baseline " + ofToString( baseline.threads ) + ")" );
+			}
+			if ( recorder.getStats().queuedBytes != 0 ) {
+				fail( "cycle " + ofToString( i ) + ": queue still holds " + ofToString( recorder.getStats().queuedBytes ) + " bytes after finishing" );
+			}
+
+			if ( i % 20 == 0 ) sample( "cycles", recorder );
+			if ( !failures.empty() ) return;
+		}
+	}
+
+	void runContinuous()
+	{
+		Recorder recorder;
+		if ( !recorder.start( settings ) ) {
+			fail( "continuous: unable to start" );
+			return;
+		}
+
+		const size_t maxQueued = options.maxQueuedFrames ? options.maxQueuedFrames : size_t( settings.fps * 2 );
+		const TimePoint start  = Clock::now();
+		std::vector<std::pair<float, double>> rss;  // (hours, MB)
+
+		while ( Seconds( Clock::now() - start ).count() < options.duration ) {
+			// wander between 0.5x and 2x the frame rate
+			std::uniform_real_distribution<float> scale( 0.5f, 2.f );
+			const float rateScale = scale( rng );
+			produce( recorder, options.sampleInterval, [=] { return rateScale; } );
+
+			const ofJson s = sample( "continuous", recorder );
+			rss.emplace_back( Seconds( Clock::now() - start ).count() / 3600.f, s["rssBytes"].get<double>() / ( 1024. * 1024. ) );
+
+			const size_t queued = s["queuedFrames"].get<size_t>();
+			if ( queued > maxQueued ) {
+				fail( "continuous: queue grew to " + ofToString( queued ) + " frames (limit " + ofToString( maxQueued ) + ")" );
+				break;
+			}
+		}
+
+		recorder.stop();
+		if ( !waitUntilReady( recorder ) ) {
+			fail( "continuous: recorder never became ready after stop()" );
+		}
+
+		// least squares slope over the second half, after allocators and caches have warmed up
+		if ( rss.size() >= 8 ) {
+			const size_t first = rss.size() / 2;
+			const double n     = double( rss.size() - first );
+			double sx = 0., sy = 0., sxx = 0., sxy = 0.;
+			for ( size_t i = first; i < rss.size(); ++i ) {
+				sx += rss[i].first;
+				sy += rss[i].second;
+				sxx += rss[i].first * rss[i].first;
+				sxy += rss[i].first * rss[i].second;
+			}
+			const double slope = ( n * sxy - sx * sy ) / std::max( 1e-12, n * sxx - sx * sx );
+			ofLogNotice( "soak" ) << "RSS slope: " << slope << " MB/hour";
+
+			if ( slope > options.maxRssSlope ) {
+				fail( "continuous: RSS grows " + ofToString( slope ) + " MB/hour (limit " + ofToString( options.maxRssSlope ) + ")" );
+			}
+		}
+	}
+};
+
+int main( int argc, char **argv )
+{
+	Options options;
+	for ( int i = 1; i + 1 < argc; i += 2 ) {
+		const std::string arg = argv[i];
+		if ( arg == "--sink" ) options.sinkPath = argv[i + 1];
+		else if ( arg == "--cycles" ) options.nCycles = ofToInt( argv[i + 1] );
+		else if ( arg == "--duration" ) options.duration = ofToFloat( argv[i + 1] );
+		else if ( arg == "--interval" ) options.sampleInterval = ofToFloat( argv[i + 1] );
+		else if ( arg == "--max-rss-slope" ) options.maxRssSlope = ofToFloat( argv[i + 1] );
+		else if ( arg == "--out" ) options.outputPrefix = argv[i + 1];
+	}
+
+	ofSetLogLevel( "ofxFFmpeg", OF_LOG_WARNING );
+
+	Harness harness;
+	harness.options                  = options;
+	harness.settings.videoResolution = { 1280, 720 };
+	harness.settings.fps             = 30.f;
+	harness.settings.ffmpegPath      = options.sinkPath;
+	harness.settings.outputPath      = ofToDataPath( options.outputPrefix + "-sink.json", true );
+	harness.pixels.allocate( harness.settings.videoResolution.x, harness.settings.videoResolution.y, OF_PIXELS_RGB );
+	harness.samples.open( ofToDataPath( options.outputPrefix + "-samples.jsonl", true ) );
+
+	ofLogNotice( "soak" ) << "Running " << options.nCycles << " start/stop cycles...";
+	harness.runCycles();
+
+	if ( harness.failures.empty() ) {
+		ofLogNotice( "soak" ) << "Recording continuously for " << options.duration << " seconds...";
+		harness.runContinuous();
+	}
+
+	ofJson summary = {
+	    { "passed", harness.failures.empty() },
+	    { "failures", harness.failures },
+	    { "seconds", Seconds( Clock::now() - harness.begin ).count() },
+	};
+	std::cout << summary.dump( 2 ) << std::endl;
+	ofSaveJson( options.outputPrefix + "-summary.json", summary );
+
+	return harness.failures.empty() ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+// Headless end-to-end throughput benchmark for ofxFFmpeg::Recorder.
+//
+// Drives the recorder with synthetic frames at several resolutions and frame rates, piping into a stand-in
+// ffmpeg (benchmarks/sink) so results reflect the recorder, not the encoder. No window, GPU or camera needed.
+// Also compares start() stall and time-to-first-frame with and without a pre-warmed ffmpeg process.
+//
+// Usage: throughput [--sink <path to ffmpeg-sink or ffmpeg>] [--duration <seconds>] [--out <results.json>]
+
+#include "../../common/BenchmarkUtils.h"
+#include "ofMain.h"
+#include "ofxFFmpeg.h"
+
+using namespace ofxFFmpeg;
+using namespace ofxFFmpegBenchmark;
+
+struct Config
+{
+	std::string name;
+	glm::ivec2 resolution;
+	float fps;
+};
+
+ofJson runBenchmark( const Config &config, const std::string &sinkPath, float duration )
+{
+	RecorderSettings settings;
+	settings.videoResolution = config.resolution;
+	settings.fps             = config.fps;
+	settings.ffmpegPath      = sinkPath;
+	settings.outputPath      = ofToDataPath( "sink-report-" + config.name + ".json", true );
+
+	// synthetic frame, content changes every frame so nothing can be optimized away
+	ofPixels pixels;
+	pixels.allocate( config.resolution.x, config.resolution.y, OF_PIXELS_RGB );
+
+	Recorder recorder;
+	resetPeakRss();
+	const ProcessUsage usageStart = getProcessUsage();
+
+	// main-thread stall caused by spawning the encoder
+	const TimePoint startBegin = Clock::now();
+	if ( !recorder.start( settings ) ) {
+		return { { "name", config.name }, { "error", "unable to start recorder" } };
+	}
+	const float startStall = Seconds( Clock::now() - startBegin ).count();
+
+	// produce frames at the target rate, like an app calling addFrame() from draw()
+	const TimePoint begin  = Clock::now();
+	const auto frameDur    = std::chrono::duration_cast<Clock::duration>( Seconds( 1.f / config.fps ) );
+	TimePoint nextFrame    = begin;
+	uint64_t frameCount    = 0;
+	Seconds addFrameTime   = Seconds( 0.f );
+
+	while ( Clock::now() - begin < Seconds( duration ) ) {
+		std::memset( pixels.getData(), int( frameCount++ & 0xff ), pixels.getTotalBytes() );
+
+		const TimePoint addBegin = Clock::now();
+		recorder.addFrame( pixels );
+		addFrameTime += Clock::now() - addBegin;
+
+		nextFrame += frameDur;
+		std::this_thread::sleep_until( nextFrame );
+	}
+
+	const float produceTime = Seconds( Clock::now() - begin ).count();
+	recorder.stop();
+
+	// wait for the writer to drain the queue and close the pipe
+	const TimePoint stopBegin = Clock::now();
+	while ( !recorder.isReady() && Clock::now() - stopBegin < std::chrono::seconds( 60 ) ) {
+		std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+	}
+	const float drainTime = Seconds( Clock::now() - stopBegin ).count();
+
+	const ProcessUsage usageEnd = getProcessUsage();
+	const RecorderStats stats   = recorder.getStats();
+	const float totalTime       = produceTime + drainTime;
+
+	ofJson result = {
+	    { "name", config.name },
+	    { "width", config.resolution.x },
+	    { "height", config.resolution.y },
+	    { "fps", config.fps },
+	    { "framesSubmitted", frameCount },
+	    { "framesAdded", stats.framesAdded },
+	    { "framesDuplicated", stats.framesDuplicated },
+	    { "framesDropped", stats.framesDropped },
+	    { "framesWritten", stats.framesWritten },
+	    { "framesPerSecond", stats.framesWritten / totalTime },
+	    { "bytesPerSecond", stats.bytesPerSecond },
+	    { "writeLatencyP50", stats.writeLatencyP50 },
+	    { "writeLatencyP99", stats.writeLatencyP99 },
+	    { "writeLatencyMax", stats.writeLatencyMax },
+	    { "addFrameMean", frameCount ? addFrameTime.count() / frameCount : 0.f },
+	    { "startStall", startStall },
+	    { "drainTime", drainTime },
+	    { "cpuPercent", 100. * ( usageEnd.cpuSeconds - usageStart.cpuSeconds ) / totalTime },
+	    { "peakRssBytes", usageEnd.peakRssBytes },
+	    { "ready", recorder.isReady() },
+	};
+
+	// the sink writes its own view of the throughput to the "output" path
+	ofFile report( settings.outputPath );
+	if ( report.exists() ) {
+		result["sink"] = ofJson::parse( report.readToBuffer().getText() );
+		ofFile::removeFile( settings.outputPath );
+	}
+
+	return result;
+}
+
+// start() stall and time-to-first-frame, spawning ffmpeg on start() vs claiming a pre-warmed process
+ofJson runStartBenchmark( const std::string &sinkPath, bool prewarmed, size_t nRuns )
+{
+	RecorderSettings settings;
+	settings.videoResolution = { 1920, 1080 };
+	settings.ffmpegPath      = sinkPath;
+	settings.outputPath      = ofToDataPath( "sink-report-start.json", true );
+
+	ofPixels pixels;
+	pixels.allocate( settings.videoResolution.x, settings.videoResolution.y, OF_PIXELS_RGB );
+
+	Recorder recorder;
+	if ( prewarmed ) recorder.prewarm( settings, 1 );
+
+	LatencyHistogram stall, firstFrame;
+
+	for ( size_t i = 0; i < nRuns; ++i ) {
+		// give the pool time to refill, like an app idling between recordings
+		std::this_thread::sleep_for( std::chrono::milliseconds( 500 ) );
+
+		if ( !recorder.start( settings ) ) {
+			return { { "prewarmed", prewarmed }, { "error", "unable to start recorder" } };
+		}
+		recorder.addFrame( pixels );
+
+		while ( recorder.getStats().framesWritten == 0 && recorder.isRecording() ) {
+			std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+		}
+
+		const RecorderStats stats = recorder.getStats();
+		stall.add( Seconds( stats.startStall ) );
+		firstFrame.add( Seconds( stats.timeToFirstFrame ) );
+
+		recorder.stop();
+		while ( !recorder.isReady() ) {
+			std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+		}
+	}
+
+	recorder.prewarm( settings, 0 );
+	ofFile::removeFile( settings.outputPath );
+
+	return {
+	    { "prewarmed", prewarmed },
+	    { "runs", nRuns },
+	    { "startStallP50", stall.getPercentile( 0.5f ).count() },
+	    { "startStallMax", stall.getMax().count() },
+	    { "timeToFirstFrameP50", firstFrame.getPercentile( 0.5f ).count() },
+	    { "timeToFirstFrameMax", firstFrame.getMax().count() },
+	};
+}
+
+int main( int argc, char **argv )
+{
+	std::string sinkPath   = "ffmpeg-sink";
+	std::string outputPath = "throughput.json";
+	float duration         = 5.f;
+
+	for ( int i = 1; i + 1 < argc; i += 2 ) {
+		const std::string arg = argv[i];
+		if ( arg == "--sink" ) sinkPath = argv[i + 1];
+		else if ( arg == "--duration" ) duration = ofToFloat( argv[i + 1] );
+		else if ( arg == "--out" ) outputPath = argv[i + 1];
+	}
+
+	ofSetLogLevel( "ofxFFmpeg", OF_LOG_WARNING );
+
+	const std::vector<Config> configs = {
+	    { "720p30", { 1280, 720 }, 30.f },
+	    { "720p60", { 1280, 720 }, 60.f },
+	    { "1080p30", { 1920, 1080 }, 30.f },
+	    { "1080p60", { 1920, 1080 }, 60.f },
+	    { "4k30", { 3840, 2160 }, 30.f },
+	    { "4k60", { 3840, 2160 }, 60.f },
+	    { "8k24", { 7680, 4320 }, 24.f },
+	    { "8k30", { 7680, 4320 }, 30.f },
+	};
+
+	ofJson results = ofJson::array();
+	for ( const auto &config : configs ) {
+		ofLogNotice( "benchmark" ) << "Running " << config.name << "...";
+		results.push_back( runBenchmark( config, sinkPath, duration ) );
+	}
+
+	ofJson startResults = ofJson::array();
+	for ( bool prewarmed : { false, true } ) {
+		ofLogNotice( "benchmark" ) << "Running start " << ( prewarmed ? "(pre-warmed)" : "(cold)" ) << "...";
+		startResults.push_back( runStartBenchmark( sinkPath, prewarmed, 20 ) );
+	}
+
+	ofJson output = { { "benchmark", "throughput" }, { "sink", sinkPath }, { "duration", duration }, { "results", results }, { "start", startResults } };
+	std::cout << output.dump( 2 ) << std::endl;
+	ofSaveJson( outputPath, output );
+
+	return 0;
+}
@@ -0,0 +1,103 @@
+// Headless thumbnail benchmark for ofxFFmpeg::getThumbnails().
+//
+// Decodes the same evenly spread thumbnails with 1, 2, 4, ... ffmpeg processes up to the number of cores, and reports
+// the wall time and speedup of each, for keyframe-only and exact seeks. Without --input it encodes a test file first
+// (1080p30, 10 minutes, a keyframe every 2 seconds), which needs libx264.
+//
+// Usage: thumbnails [--input <file>] [--ffmpeg <path>] [--ffprobe <path>] [--count <thumbnails>] [--sheet <image>] [--out <results.json>]
+
+#include "ofMain.h"
+#include "ofxFFmpeg.h"
+
+using namespace ofxFFmpeg;
+
+std::string createTestFile( const std::string &ffmpegPath )
+{
+	const std::string path = ofToDataPath( "thumbnails-test.mp4", true );
+	if ( ofFile::doesFileExist( path, false ) ) return path;
+
+	ofLogNotice( "benchmark" ) << "Encoding " << path << "...";
+	const std::string cmd = ffmpegPath +
+	                        " -y -v error -f lavfi -i testsrc2=size=1920x1080:rate=30 -t 600"
+	                        " -c:v libx264 -preset ultrafast -g 60 -pix_fmt yuv420p \"" +
+	                        path + "\"";
+	return std::system( cmd.c_str() ) == 0 ? path : "";
+}
+
+ofJson runBenchmark( const std::string &inputPath, ThumbnailSettings settings, size_t nThumbnails, float baseline )
+{
+	const TimePoint begin                  = Clock::now();
+	const std::vector<ofPixels> thumbnails = getThumbnails( inputPath, nThumbnails, settings );
+	const float elapsed                    = Seconds( Clock::now() - begin ).count();
+
+	const size_t nDecoded = std::count_if( thumbnails.begin(), thumbnails.end(), []( const ofPixels &pixels ) { return pixels.isAllocated(); } );
+	return {
+	    { "threads", settings.threads },
+	    { "keyframesOnly", settings.keyframesOnly },
+	    { "thumbnails", nDecoded },
+	    { "failed", thumbnails.size() - nDecoded },
+	    { "seconds", elapsed },
+	    { "thumbnailsPerSecond", elapsed > 0.f ? nDecoded / elapsed : 0.f },
+	    { "speedup", elapsed > 0.f && baseline > 0.f ? baseline / elapsed : 1.f },
+	};
+}
+
+int main( int argc, char **argv )
+{
+	std::string inputPath   = "";
+	std::string ffmpegPath  = "ffmpeg";
+	std::string ffprobePath = "ffprobe";
+	std::string sheetPath   = "";
+	std::string outputPath  = "thumbnails.json";
+	size_t nThumbnails      = 100;
+
+	for ( int i = 1; i + 1 < argc; i += 2 ) {
+		const std::string arg = argv[i];
+		if ( arg == "--input" ) inputPath = argv[i + 1];
+		else if ( arg == "--ffmpeg" ) ffmpegPath = argv[i + 1];
+		else if ( arg == "--ffprobe" ) ffprobePath = argv[i + 1];
+		else if ( arg == "--count" ) nThumbnails = ofToInt( argv[i + 1] );
+		else if ( arg == "--sheet" ) sheetPath = argv[i + 1];
+		else if ( arg == "--out" ) outputPath = argv[i + 1];
+	}
+
+	ofSetLogLevel( "ofxFFmpeg", OF_LOG_WARNING );
+
+	if ( inputPath.empty() ) inputPath = createTestFile( ffmpegPath );
+	if ( inputPath.empty() ) {
+		ofLogError( "benchmark" ) << "Unable to create a test file, pass one with --input";
+		return 1;
+	}
+
+	const size_t nCores = std::max( 1u, std::thread::hardware_concurrency() );
+
+	ofJson results = ofJson::array();
+	for ( bool keyframesOnly : { true, false } ) {
+		float baseline = 0.f;
+		for ( size_t nThreads = 1;; nThreads = std::min( nThreads * 2, nCores ) ) {
+			ThumbnailSettings settings;
+			settings.ffmpegPath    = ffmpegPath;
+			settings.ffprobePath   = ffprobePath;
+			settings.threads       = nThreads;
+			settings.keyframesOnly = keyframesOnly;
+
+			ofLogNotice( "benchmark" ) << "Running " << nThreads << " threads" << ( keyframesOnly ? " (keyframes)" : " (exact)" ) << "...";
+			results.push_back( runBenchmark( inputPath, settings, nThumbnails, baseline ) );
+			if ( nThreads == 1 ) baseline = results.back()["seconds"];
+			if ( nThreads == nCores ) break;
+		}
+	}
+
+	if ( !sheetPath.empty() ) {
+		ThumbnailSettings settings;
+		settings.ffmpegPath  = ffmpegPath;
+		settings.ffprobePath = ffprobePath;
+		ofSaveImage( getContactSheet( getThumbnails( inputPath, nThumbnails, settings ), 10, 2 ), sheetPath );
+	}
+
+	ofJson output = { { "benchmark", "thumbnails" }, { "input", inputPath }, { "cores", nCores }, { "results", results } };
+	std::cout << output.dump( 2 ) << std::endl;
+	ofSaveJson( outputPath, output );
+
+	return 0;
+}
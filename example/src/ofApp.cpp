@@ -81,11 +81,12 @@ void ofApp::keyReleased( int key )
 
 	if ( key == ' ' ) {
 		// toggle recording
+		// the async versions spawn and finalize ffmpeg in the background, so drawing never stalls
 		if ( m_recorder.isRecording() ) {
-			m_recorder.stop();
+			m_recorder.stopAsync();
 
 		} else if ( m_recorder.isReady() ) {
-			m_recorder.start( m_recorderSettings );
+			m_recorder.startAsync( m_recorderSettings );
 		}
 	}
 }
@@ -1,9 +1,23 @@
 #include "ofxFFmpeg.h"
+#include "ofxFFmpegProcess.h"
 // openFrameworks
 #include "ofLog.h"
+#include "ofMath.h"
+#include "ofSoundBuffer.h"
 #include "ofSoundStream.h"
 #include "ofVideoGrabber.h"
 
+#include <cctype>
+#include <fstream>
+
+#if !defined( _WIN32 )
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 // Logging macros
 #define LOG_ERROR() ofLogError( "ofxFFmpeg" ) << __FUNCTION__ << ": "
 #define LOG_WARNING() ofLogWarning( "ofxFFmpeg" ) << __FUNCTION__ << ": "
@@ -11,16 +25,320 @@
 #define LOG_VERBOSE() ofLogVerbose( "ofxFFmpeg" ) << __FUNCTION__ << ": "
 #define LOG() LOG_NOTICE()
 
-// Subprocess macros
+namespace ofxFFmpeg {
+
+// -----------------------------------------------------------------
+// Audio is fed to ffmpeg as a second input through a named pipe (a FIFO on posix),
+// since the stdin pipe is already taken by the video frames.
+namespace {
+
+	bool createAudioPipe( std::string &path, intptr_t &pipe )
+	{
+		static std::atomic<int> counter { 0 };
+
 #if defined( _WIN32 )
-#define P_CLOSE( file ) _pclose( file )
-#define P_OPEN( cmd ) _popen( cmd, "wb" )  // write binary?
+		path         = "\\\\.\\pipe\\ofxffmpeg-audio-" + std::to_string( GetCurrentProcessId() ) + "-" + std::to_string( counter++ );
+		HANDLE h     = CreateNamedPipeA( path.c_str(), PIPE_ACCESS_OUTBOUND, PIPE_TYPE_BYTE | PIPE_NOWAIT, 1, 1 << 16, 0, 0, nullptr );
+		pipe         = reinterpret_cast<intptr_t>( h );
+		return h != INVALID_HANDLE_VALUE;
 #else
-#define P_CLOSE( file ) pclose( file )
-#define P_OPEN( cmd ) popen( cmd, "w" )
+		path = std::string( P_tmpdir ) + "/ofxffmpeg-audio-" + std::to_string( getpid() ) + "-" + std::to_string( counter++ );
+		pipe = -1;
+		unlink( path.c_str() );
+		return mkfifo( path.c_str(), 0600 ) == 0;
 #endif
+	}
 
-namespace ofxFFmpeg {
+	// non-blocking, returns false until ffmpeg has opened the read end
+	bool connectAudioPipe( const std::string &path, intptr_t &pipe )
+	{
+#if defined( _WIN32 )
+		HANDLE h = reinterpret_cast<HANDLE>( pipe );
+		if ( ConnectNamedPipe( h, nullptr ) || GetLastError() == ERROR_PIPE_CONNECTED ) {
+			DWORD mode = PIPE_READMODE_BYTE | PIPE_WAIT;  // blocking writes from here on
+			SetNamedPipeHandleState( h, &mode, nullptr, nullptr );
+			return true;
+		}
+		return false;
+#else
+		const int fd = open( path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC );  // another ffmpeg holding the write end would never see EOF
+		if ( fd < 0 ) return false;  // ENXIO - no reader yet
+		fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) & ~O_NONBLOCK );
+		pipe = fd;
+		return true;
+#endif
+	}
+
+	bool writeAudioPipe( intptr_t pipe, const float *data, size_t count )
+	{
+		const char *bytes = reinterpret_cast<const char *>( data );
+		size_t length     = count * sizeof( float );
+
+		while ( length > 0 ) {
+#if defined( _WIN32 )
+			DWORD written = 0;
+			if ( !WriteFile( reinterpret_cast<HANDLE>( pipe ), bytes, DWORD( length ), &written, nullptr ) ) return false;
+#else
+			const ssize_t written = write( int( pipe ), bytes, length );
+			if ( written < 0 ) {
+				if ( errno == EINTR ) continue;
+				return false;
+			}
+#endif
+			bytes += written;
+			length -= written;
+		}
+		return true;
+	}
+
+	void closeNamedPipe( const std::string &path, intptr_t &pipe )
+	{
+#if defined( _WIN32 )
+		if ( pipe != -1 ) CloseHandle( reinterpret_cast<HANDLE>( pipe ) );
+#else
+		if ( pipe != -1 ) close( int( pipe ) );
+		unlink( path.c_str() );
+#endif
+		pipe = -1;
+	}
+
+	// the replay buffer reads ffmpeg's output back through another named pipe, stdout isn't available with popen( "w" )
+	bool createOutputPipe( std::string &path, intptr_t &pipe )
+	{
+		static std::atomic<int> counter { 0 };
+
+#if defined( _WIN32 )
+		path     = "\\\\.\\pipe\\ofxffmpeg-replay-" + std::to_string( GetCurrentProcessId() ) + "-" + std::to_string( counter++ );
+		HANDLE h = CreateNamedPipeA( path.c_str(), PIPE_ACCESS_INBOUND, PIPE_TYPE_BYTE | PIPE_NOWAIT, 1, 0, 1 << 20, 0, nullptr );
+		pipe     = reinterpret_cast<intptr_t>( h );
+		return h != INVALID_HANDLE_VALUE;
+#else
+		path = std::string( P_tmpdir ) + "/ofxffmpeg-replay-" + std::to_string( getpid() ) + "-" + std::to_string( counter++ );
+		pipe = -1;
+		unlink( path.c_str() );
+		if ( mkfifo( path.c_str(), 0600 ) != 0 ) return false;
+		pipe = open( path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC );  // doesn't wait for ffmpeg to open the write end
+		return pipe >= 0;
+#endif
+	}
+
+	// returns the number of bytes read, 0 if there's nothing to read yet, -1 once ffmpeg has closed its end
+	int readOutputPipe( intptr_t pipe, char *data, size_t size, bool &isConnected )
+	{
+#if defined( _WIN32 )
+		HANDLE h = reinterpret_cast<HANDLE>( pipe );
+		if ( !isConnected ) {
+			if ( !ConnectNamedPipe( h, nullptr ) && GetLastError() != ERROR_PIPE_CONNECTED ) return 0;
+			DWORD mode = PIPE_READMODE_BYTE | PIPE_WAIT;  // blocking reads from here on
+			SetNamedPipeHandleState( h, &mode, nullptr, nullptr );
+			isConnected = true;
+		}
+		DWORD nRead = 0;
+		if ( !ReadFile( h, data, DWORD( size ), &nRead, nullptr ) ) return -1;  // ERROR_BROKEN_PIPE
+		return int( nRead );
+#else
+		const ssize_t nRead = read( int( pipe ), data, size );
+		if ( nRead > 0 ) {
+			isConnected = true;
+			return int( nRead );
+		}
+		if ( nRead == 0 ) {
+			return isConnected ? -1 : 0;  // no writer - not yet, or not anymore
+		}
+		if ( errno == EAGAIN ) {
+			isConnected = true;  // there is a writer, it just hasn't written anything
+			pollfd fd   = { int( pipe ), POLLIN, 0 };
+			poll( &fd, 1, 100 );
+			return 0;
+		}
+		return errno == EINTR ? 0 : -1;
+#endif
+	}
+
+	std::string getCommand( const RecorderSettings &settings, const std::string &outputPath, const std::string &audioPipePath )
+	{
+		std::string cmd               = settings.ffmpegPath.empty() ? "ffmpeg" : settings.ffmpegPath;
+		std::vector<std::string> args = {
+		    "-y",                                 // overwrite
+		    settings.recordAudio ? "" : "-an",  // disable audio
+
+		    // video input
+		    "-r " + ofToString( settings.fps ),                      // input frame rate
+		    "-s " + std::to_string( settings.videoResolution.x ) +   // input resolution x
+		        "x" + std::to_string( settings.videoResolution.y ),  // input resolution y
+		    "-f rawvideo",                                           // input codec
+		    "-pix_fmt rgb24",                                        // input pixel format
+		    settings.extraInputArgs,                                 // custom input args
+		    settings.recordAudio ? "-thread_queue_size 512" : "",   // inputs are read concurrently, don't let one starve the other
+		    "-i pipe:",                                              // input source (default pipe)
+		};
+
+		if ( settings.recordAudio ) {
+			const bool asyncDrift = settings.audioDriftCorrection == AudioDriftCorrection::FFmpegAsync;
+
+			args.insert( args.end(), {
+			                             // audio input
+			                             asyncDrift ? "-use_wallclock_as_timestamps 1" : "",  // timestamp samples as they arrive, so aresample can measure the drift
+			                             "-f f32le",                                          // interleaved 32 bit float samples, as delivered by ofSoundBuffer
+			                             "-ar " + std::to_string( settings.audioSampleRate ),   // input sample rate
+			                             "-ac " + std::to_string( settings.audioChannels ),     // input channel count
+			                             "-thread_queue_size 512",                             //
+			                             "-i \"" + audioPipePath + "\"",                      // input source (named pipe)
+
+			                             // audio output
+			                             "-map 0:v",                                                //
+			                             "-map 1:a",                                                //
+			                             asyncDrift ? "-af aresample=async=1000:first_pts=0" : "",  // stretch/squeeze up to 1000 samples per second to follow the timestamps
+			                             "-c:a " + settings.audioCodec,                             // output codec
+			                             "-b:a " + ofToString( settings.audioBitrate ) + "k",       // output bitrate kbps
+			                         } );
+		}
+
+		// a crashed ffmpeg never writes the moov atom, so write the index with every fragment instead
+		const std::string ext   = ofToLower( ofFilePath::getFileExt( outputPath ) );
+		const bool isFragmented = settings.restartOnFailure && ( ext == "mp4" || ext == "mov" || ext == "m4v" );
+
+		args.insert( args.end(), {
+		                             // video output
+		                             "-r " + ofToString( settings.fps ),                                                    // output frame rate
+		                             "-c:v " + settings.videoCodec,                                                         // output codec
+		                             "-b:v " + ofToString( settings.bitrate ) + "k",                                        // output bitrate kbps (hint)
+		                             isFragmented ? "-movflags +empty_moov+default_base_moof -frag_duration 1000000" : "",  // one second fragments
+		                             settings.extraOutputArgs,                                                              // custom output args
+		                             outputPath                                                                             // output path
+		                         } );
+
+		for ( const auto &arg : args ) {
+			if ( !arg.empty() ) cmd += " " + arg;
+		}
+
+		return cmd;
+	}
+
+	// settings that produce the same ffmpeg command (apart from the output file name) can share a pre-warmed process
+	bool isPrewarmCompatible( const RecorderSettings &a, const RecorderSettings &b )
+	{
+		const std::string extA = ofFilePath::getFileExt( a.outputPath );
+		const std::string extB = ofFilePath::getFileExt( b.outputPath );
+		return extA == extB && getCommand( a, "out." + extA, "" ) == getCommand( b, "out." + extB, "" );
+	}
+
+	bool hasSegments( const RecorderSettings &settings )
+	{
+		return settings.segmentDuration > 0.f || settings.segmentSize > 0;
+	}
+
+	// outputPath with its single %d or %0Nd replaced by index and %% by %, empty if it isn't a pattern like that - the
+	// path is user input, so it's never handed to printf
+	std::string formatSegmentPattern( const std::string &path, size_t index )
+	{
+		std::string formatted;
+		int nConversions = 0;
+		for ( size_t i = 0; i < path.size(); ++i ) {
+			if ( path[i] != '%' ) {
+				formatted += path[i];
+				continue;
+			}
+			if ( i + 1 < path.size() && path[i + 1] == '%' ) {
+				formatted += '%';
+				++i;
+				continue;
+			}
+
+			size_t end        = i + 1;
+			const bool isZero = end < path.size() && path[end] == '0';
+			if ( isZero ) ++end;
+			int width = 0;
+			while ( end < path.size() && std::isdigit( static_cast<unsigned char>( path[end] ) ) ) {
+				width = std::min( width * 10 + ( path[end++] - '0' ), 32 );
+			}
+			if ( end >= path.size() || path[end] != 'd' || ( width > 0 && !isZero ) || ++nConversions > 1 ) return "";
+
+			formatted += width > 0 ? ofToString( index, width, '0' ) : ofToString( index );
+			i = end;
+		}
+		return nConversions == 1 ? formatted : "";
+	}
+
+	std::string getSegmentPath( const RecorderSettings &settings, size_t index )
+	{
+		const std::string &path = settings.outputPath;
+		if ( path.find( '%' ) != std::string::npos ) {
+			const std::string formatted = formatSegmentPattern( path, index );
+			if ( !formatted.empty() ) return formatted;
+		}
+		const std::string ext = ofFilePath::getFileExt( path );
+		return ofFilePath::removeExt( path ) + "_" + ofToString( index, 3, '0' ) + ( ext.empty() ? "" : "." + ext );
+	}
+
+	bool spawnEncoder( const RecorderSettings &settings, const std::string &outputPath, EncoderProcess &encoder )
+	{
+		encoder.outputPath = outputPath;
+		encoder.finalPath  = outputPath;
+
+		if ( settings.recordAudio && !createAudioPipe( encoder.audioPipePath, encoder.audioPipe ) ) {
+			LOG_ERROR() << "Unable to create audio pipe: " << encoder.audioPipePath;
+			return false;
+		}
+
+		const std::string cmd = getCommand( settings, outputPath, encoder.audioPipePath );
+		LOG() << "Starting ffmpeg with command...\n\t" << cmd << "\n";
+
+		encoder.pipe = openProcess( cmd, encoder.pid );
+
+		if ( !encoder.pipe ) {
+			// get error string from 'errno' code
+			char errmsg[500];
+			strerror_s( errmsg, 500, errno );
+			LOG_ERROR() << "Unable to start ffmpeg. Error: " << errmsg;
+			if ( settings.recordAudio ) closeNamedPipe( encoder.audioPipePath, encoder.audioPipe );
+			return false;
+		}
+
+		return true;
+	}
+
+	// closes an encoder that never received frames, and removes whatever it left behind
+	void discardEncoder( EncoderProcess &encoder )
+	{
+		if ( encoder.pipe ) closeProcess( encoder.pipe, encoder.pid );
+		encoder.pipe = nullptr;
+		if ( !encoder.audioPipePath.empty() ) closeNamedPipe( encoder.audioPipePath, encoder.audioPipe );
+		if ( ofFile::doesFileExist( encoder.outputPath, false ) ) ofFile::removeFile( encoder.outputPath, false );
+	}
+
+	// waits for ffmpeg to finish the file, then moves it to its final path - returns false if anything went wrong
+	bool closeEncoder( EncoderProcess &encoder )
+	{
+		bool isFinalized = true;
+
+		if ( encoder.pipe ) {
+			const int status = closeProcess( encoder.pipe, encoder.pid );
+			if ( status < 0 ) {
+				// get error string from 'errno' code
+				char errmsg[500];
+				strerror_s( errmsg, 500, errno );
+				LOG_ERROR() << "Error closing FFmpeg pipe. Error: " << errmsg;
+			} else if ( status != 0 ) {
+				LOG_WARNING() << "FFmpeg exited with status " << status << " for " << encoder.finalPath;
+			}
+			isFinalized = status == 0;
+		}
+
+		encoder.pipe = nullptr;
+
+		// pre-warmed processes write to a temporary file, now that ffmpeg is done it can go where it was asked to
+		if ( !encoder.outputPath.empty() && encoder.outputPath != encoder.finalPath ) {
+			if ( !ofFile::moveFromTo( encoder.outputPath, encoder.finalPath, false, true ) ) {
+				LOG_ERROR() << "Unable to move recording from " << encoder.outputPath << " to " << encoder.finalPath;
+				isFinalized = false;
+			}
+			encoder.outputPath = encoder.finalPath;
+		}
+
+		return isFinalized;
+	}
+}  // namespace
 
 // -----------------------------------------------------------------
 Recorder::Recorder()
@@ -30,20 +348,47 @@ Recorder::Recorder()
 // -----------------------------------------------------------------
 Recorder::~Recorder()
 {
+	if ( m_startThread.joinable() ) m_startThread.join();
 	stop();
+	stopPreRoll();
 	if ( m_thread.joinable() ) m_thread.join();
+	if ( m_audioThread.joinable() ) m_audioThread.join();
+	if ( m_replayThread.joinable() ) m_replayThread.join();
+	// remuxes only copy streams, one still running after stallTimeout is hung on its disk - like a stalled stop(), it's killed
+	const TimePoint deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>( Seconds( m_settings.stallTimeout ) );
+	for ( auto &save : m_replaySaves ) {
+		while ( m_settings.stallTimeout > 0.f && !*save.isDone && Clock::now() < deadline ) {
+			std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+		}
+		if ( m_settings.stallTimeout > 0.f && !*save.isDone ) killProcess( save.pid->load() );
+		save.thread.join();
+	}
+	prewarm( m_prewarmSettings, 0 );
 }
 
 // -----------------------------------------------------------------
 bool Recorder::start( const RecorderSettings &settings )
 {
+	if ( isStarting() ) {
+		LOG_WARNING() << "Can't start recording - already starting.";
+		return false;
+	}
+
+	const TimePoint startCallTime = Clock::now();
+	const bool isStarted          = startEncoder( settings, startCallTime );
+	m_startStall                  = Seconds( Clock::now() - startCallTime ).count();
+	return isStarted;
+}
 
+// -----------------------------------------------------------------
+bool Recorder::startEncoder( const RecorderSettings &settings, TimePoint startCallTime )
+{
 	if ( isRecording() ) {
 		LOG_WARNING() << "Can't start recording - already started.";
 		return false;
 	}
 
-	if ( !isReady() ) {
+	if ( m_isEncoderOpen || m_frames.size() || m_isWritingAudio || m_isReadingReplay ) {
 		LOG_ERROR() << "Can't start recording - previous recording is still processing.";
 		return false;
 	}
@@ -53,8 +398,15 @@ bool Recorder::start( const RecorderSettings &settings )
 		return false;
 	}
 
-	if ( ofFile::doesFileExist( ofToDataPath( m_settings.outputPath, true ), false ) && !m_settings.allowOverwrite ) {
-		LOG_ERROR() << "The output file already exists and overwriting is disabled. Can't record to file: " << m_settings.outputPath;
+	const std::string outputPath = hasSegments( settings ) ? ofxFFmpeg::getSegmentPath( settings, 0 ) : settings.outputPath;
+
+	if ( ofFile::doesFileExist( ofToDataPath( outputPath, true ), false ) && !settings.allowOverwrite ) {
+		LOG_ERROR() << "The output file already exists and overwriting is disabled. Can't record to file: " << outputPath;
+		return false;
+	}
+
+	if ( settings.recordAudio && ( settings.audioSampleRate == 0 || settings.audioChannels == 0 ) ) {
+		LOG_ERROR() << "Can't start recording - invalid audio sample rate or channel count.";
 		return false;
 	}
 
@@ -64,64 +416,395 @@ bool Recorder::start( const RecorderSettings &settings )
 		m_settings.ffmpegPath = "ffmpeg";
 	}
 
-	m_nAddedFrames = 0;
-
-	std::string cmd               = m_settings.ffmpegPath;
-	std::vector<std::string> args = {
-	    "-y",   // overwrite
-	    "-an",  // disable audio -- todo: add audio,
+	if ( m_settings.recordAudio && isSegmenting() ) {
+		// the audio writer runs on its own clock, it can't switch pipes on the video writer's frame boundary
+		LOG_WARNING() << "Segments aren't supported when recording audio, recording to a single file.";
+		m_settings.segmentDuration = 0.f;
+		m_settings.segmentSize     = 0;
+	}
 
-	    // input
-	    "-r " + ofToString( m_settings.fps ),                      // input frame rate
-	    "-s " + std::to_string( m_settings.videoResolution.x ) +   // input resolution x
-	        "x" + std::to_string( m_settings.videoResolution.y ),  // input resolution y
-	    "-f rawvideo",                                             // input codec
-	    "-pix_fmt rgb24",                                          // input pixel format
-	    m_settings.extraInputArgs,                                 // custom input args
-	    "-i pipe:",                                                // input source (default pipe)
+	if ( m_settings.recordAudio && m_settings.restartOnFailure ) {
+		LOG_WARNING() << "Restarting ffmpeg isn't supported when recording audio, restartOnFailure is off.";
+		m_settings.restartOnFailure = false;
+	}
 
-	    // output
-	    "-r " + ofToString( m_settings.fps ),              // output frame rate
-	    "-c:v " + m_settings.videoCodec,                   // output codec
-	    "-b:v " + ofToString( m_settings.bitrate ) + "k",  // output bitrate kbps (hint)
-	    m_settings.extraOutputArgs,                        // custom output args
-	    m_settings.outputPath                              // output path
-	};
+	if ( m_settings.recordAudio && m_settings.stallAction == StallAction::Restart ) {
+		LOG_WARNING() << "Restarting ffmpeg isn't supported when recording audio, stalls drop frames instead.";
+		m_settings.stallAction = StallAction::Drop;
+	}
 
-	for ( const auto &arg : args ) {
-		if ( !arg.empty() ) cmd += " " + arg;
+#if !defined( _WIN32 )
+	if ( m_settings.restartOnFailure || m_settings.stallTimeout > 0.f ) {
+		signal( SIGPIPE, SIG_IGN );  // a dead ffmpeg has to fail writes with EPIPE rather than terminate the app
 	}
+#endif
+
+	m_nAddedFrames    = 0;
+	m_hasVideoStarted = false;
+
+	m_nUniqueFrames     = 0;
+	m_nDuplicatedFrames = 0;
+	m_nDroppedFrames    = 0;
+	m_nWrittenFrames    = 0;
+	m_queuedBytes       = 0;
+	m_bytesWritten      = 0;
+	m_writerIdleTime    = 0.f;
+	m_lastWriteTime     = TimePoint();
+	m_nDiscardedFrames  = 0;
+	m_timeToFirstFrame  = 0.f;
+	m_startCallTime     = startCallTime;
+	m_writeLatency.reset();
+	m_nSegments     = 1;
+	m_segmentFrames = 0;
+	m_audioLeadIn   = 0;
+	m_isPaused      = false;
+	m_pausedTime    = 0.f;
+	m_nRestarts     = 0;
+	m_nStalls       = 0;
+	m_stallTime     = 0.f;
+
+	m_nConsecutiveRestarts = 0;
+	m_outputFiles.clear();
 
-	if ( m_ffmpegPipe != nullptr ) {
-		P_CLOSE( m_ffmpegPipe );
+	if ( m_settings.recordAudio ) {
+		if ( m_audioThread.joinable() ) m_audioThread.join();
+
+		// preallocate, so the sound callback never has to
+		const size_t sampleFrames = std::max( 1.f, m_settings.audioBufferDuration * m_settings.audioSampleRate );
+		m_audioSamples.allocate( sampleFrames * m_settings.audioChannels );
+		m_audioSamplesReceived = 0;
+		m_audioSamplesWritten  = 0;
+		m_audioOverruns        = 0;
+		m_audioUnderruns       = 0;
+		m_audioDrift           = 0.;
+		m_audioDriftRate       = 0.;
+		m_audioResampleRatio   = 1.;
 	}
 
-	LOG() << "Starting recording with command...\n\t" << cmd << "\n";
+	if ( m_encoder.pipe != nullptr ) {
+		closeProcess( m_encoder.pipe, m_encoder.pid );
+	}
+	if ( !m_encoder.audioPipePath.empty() ) {
+		closeNamedPipe( m_encoder.audioPipePath, m_encoder.audioPipe );
+	}
+	m_encoder = EncoderProcess();
 
-	m_ffmpegPipe = P_OPEN( cmd.c_str() );
+	m_usedPrewarmed = m_replayPipePath.empty() && claimPrewarmed( m_encoder );  // pre-warmed processes write to files
 
-	if ( !m_ffmpegPipe ) {
-		// get error string from 'errno' code
-		char errmsg[500];
-		strerror_s( errmsg, 500, errno );
-		LOG_ERROR() << "Unable to start recording. Error: " << errmsg;
+	if ( m_usedPrewarmed ) {
+		m_encoder.finalPath = isSegmenting() ? getSegmentPath( 0 ) : m_settings.outputPath;
+		LOG_VERBOSE() << "Recording to " << m_encoder.finalPath << " with a pre-warmed ffmpeg process.";
+	} else if ( !spawnEncoder( m_settings, isSegmenting() ? getSegmentPath( 0 ) : m_settings.outputPath, m_encoder ) ) {
+		LOG_ERROR() << "Unable to start recording.";
 		return false;
 	}
-	return m_isRecording = true;
+
+	addOutputFile( m_encoder.finalPath );
+
+	if ( isSegmenting() ) {
+		prepareNextSegment();
+	}
+
+	m_flushDeadline = TimePoint::max();
+	m_isEncoderOpen = true;
+	m_isRecording   = true;
+
+	if ( m_isPreRolling ) {
+		flushPreRoll();
+	}
+
+	if ( m_settings.recordAudio ) {
+		m_isWritingAudio = true;
+		m_audioThread    = std::thread( &Recorder::processAudio, this );
+	}
+
+	return true;
+}
+
+// -----------------------------------------------------------------
+void Recorder::stop( float flushTimeout )
+{
+	{
+		std::lock_guard<std::mutex> lock( m_finalizeMutex );
+		if ( m_isStarting ) {
+			// startAsync() would set m_isRecording again once ffmpeg is up - it stops the recording then instead
+			m_isStopPending       = true;
+			m_pendingFlushTimeout = flushTimeout;
+			return;
+		}
+	}
+
+	m_flushDeadline = flushTimeout < 0.f ? TimePoint::max() : Clock::now() + std::chrono::duration_cast<Clock::duration>( Seconds( flushTimeout ) );
+
+	const bool wasRecording = m_isRecording.exchange( false );
+	m_isPaused              = false;
+
+	// no frames were added, so the writer thread was never started - start it now, just to close the pipe
+	if ( wasRecording && m_nAddedFrames == 0 ) {
+		if ( m_thread.joinable() ) m_thread.join();
+		m_thread = std::thread( &Recorder::processFrame, this );
+	}
+}
+
+// -----------------------------------------------------------------
+void Recorder::pause()
+{
+	if ( !isRecording() || m_isPaused ) {
+		return;
+	}
+
+	m_pauseTime = Clock::now();
+	m_isPaused  = true;
+}
+
+// -----------------------------------------------------------------
+void Recorder::resume()
+{
+	if ( !m_isPaused ) {
+		return;
+	}
+
+	// move the start of the recording forward by the pause, so the frame clock carries on from the last frame - the sound
+	// callback and the writer threads read the start meanwhile, it's only ever written from this thread
+	const Clock::duration pausedFor = Clock::now() - m_pauseTime;
+	m_recordStartTime               = m_recordStartTime.load() + pausedFor;
+	m_lastFrameTime += pausedFor;
+	m_pausedTime = m_pausedTime + Seconds( pausedFor ).count();
+	m_isPaused   = false;
+}
+
+// -----------------------------------------------------------------
+std::future<bool> Recorder::startAsync( const RecorderSettings &settings, std::function<void( bool )> onStarted )
+{
+	std::promise<bool> promise;
+	std::future<bool> future = promise.get_future();
+
+	if ( isRecording() || m_isStarting.exchange( true ) ) {
+		LOG_WARNING() << "Can't start recording - already started.";
+		promise.set_value( false );
+		if ( onStarted ) onStarted( false );
+		return future;
+	}
+
+	const TimePoint startCallTime = Clock::now();
+	if ( m_startThread.joinable() ) m_startThread.join();  // finished, it cleared m_isStarting
+
+	m_startThread = std::thread( [this, settings, onStarted, startCallTime]( std::promise<bool> promise ) {
+		const bool isStarted = startEncoder( settings, startCallTime );
+
+		// take over any stop that was called meanwhile
+		bool isStopPending = false;
+		float flushTimeout = -1.f;
+		std::vector<std::promise<bool>> stopPromises;
+		std::vector<std::function<void( bool )>> stopCallbacks;
+		{
+			std::lock_guard<std::mutex> lock( m_finalizeMutex );
+			m_isStarting    = false;
+			isStopPending   = m_isStopPending || !m_pendingStopPromises.empty();
+			flushTimeout    = m_pendingFlushTimeout;
+			m_isStopPending = false;
+			if ( isStarted ) {
+				// resolved by finalizeOutput(), like any other stopAsync()
+				for ( auto &stopPromise : m_pendingStopPromises ) m_finalizePromises.push_back( std::move( stopPromise ) );
+				m_finalizeCallbacks.insert( m_finalizeCallbacks.end(), m_pendingStopCallbacks.begin(), m_pendingStopCallbacks.end() );
+			} else {
+				stopPromises.swap( m_pendingStopPromises );
+				stopCallbacks.swap( m_pendingStopCallbacks );
+			}
+			m_pendingStopPromises.clear();
+			m_pendingStopCallbacks.clear();
+		}
+
+		promise.set_value( isStarted );
+		if ( onStarted ) onStarted( isStarted );
+
+		if ( isStarted && isStopPending ) {
+			stop( flushTimeout );
+		}
+
+		// nothing was recorded, so nothing was finalized
+		for ( auto &stopPromise : stopPromises ) stopPromise.set_value( false );
+		for ( auto &callback : stopCallbacks ) callback( false );
+	},
+	                             std::move( promise ) );
+
+	m_startStall = Seconds( Clock::now() - startCallTime ).count();  // the calling thread only waited for the thread to spawn
+	return future;
+}
+
+// -----------------------------------------------------------------
+std::future<bool> Recorder::stopAsync( float flushTimeout, std::function<void( bool )> onFinished )
+{
+	std::promise<bool> promise;
+	std::future<bool> future = promise.get_future();
+
+	bool isPending = false;
+	{
+		std::lock_guard<std::mutex> lock( m_finalizeMutex );
+		if ( m_isStarting ) {
+			// the encoder isn't open yet, the start thread queues this behind it once it is
+			m_pendingStopPromises.push_back( std::move( promise ) );
+			if ( onFinished ) m_pendingStopCallbacks.push_back( onFinished );
+			isPending = true;
+		} else if ( m_isEncoderOpen ) {
+			m_finalizePromises.push_back( std::move( promise ) );
+			if ( onFinished ) m_finalizeCallbacks.push_back( onFinished );
+			isPending = true;
+		}
+	}
+
+	if ( !isPending ) {
+		// nothing to finalize
+		promise.set_value( true );
+		if ( onFinished ) onFinished( true );
+	}
+
+	stop( flushTimeout );
+	return future;
+}
+
+// -----------------------------------------------------------------
+void Recorder::prewarm( const RecorderSettings &settings, size_t count )
+{
+	std::vector<EncoderProcess> released;
+
+	{
+		std::lock_guard<std::mutex> lock( m_prewarmMutex );
+
+		// processes spawned for different settings are useless now
+		if ( !isPrewarmCompatible( settings, m_prewarmSettings ) || count == 0 ) {
+			released.swap( m_prewarmed );
+		}
+		while ( m_prewarmed.size() > count ) {
+			released.push_back( m_prewarmed.back() );
+			m_prewarmed.pop_back();
+		}
+
+		m_prewarmSettings = settings;
+		m_nPrewarm        = count;
+
+		m_isPrewarmThreadExiting = count == 0;
+		if ( count > 0 && !m_prewarmThread.joinable() ) {
+			m_prewarmThread = std::thread( &Recorder::processPrewarm, this );
+		}
+	}
+
+	m_prewarmCondition.notify_all();
+
+	if ( count == 0 && m_prewarmThread.joinable() ) {
+		m_prewarmThread.join();
+	}
+
+	for ( auto &encoder : released ) {
+		discardEncoder( encoder );
+	}
+}
+
+// -----------------------------------------------------------------
+size_t Recorder::getNumPrewarmed() const
+{
+	std::lock_guard<std::mutex> lock( m_prewarmMutex );
+	return m_prewarmed.size();
+}
+
+// -----------------------------------------------------------------
+bool Recorder::claimPrewarmed( EncoderProcess &encoder )
+{
+	{
+		std::lock_guard<std::mutex> lock( m_prewarmMutex );
+		if ( m_prewarmed.empty() || !isPrewarmCompatible( m_settings, m_prewarmSettings ) ) {
+			return false;
+		}
+		encoder = m_prewarmed.front();
+		m_prewarmed.erase( m_prewarmed.begin() );
+	}
+
+	m_prewarmCondition.notify_all();  // spawn a replacement
+	return true;
+}
+
+// -----------------------------------------------------------------
+void Recorder::finalizeOutput()
+{
+	// the next segment's process never got a frame
+	if ( m_nextEncoder.valid() ) {
+		EncoderProcess next = m_nextEncoder.get();
+		discardEncoder( next );
+	}
+
+	for ( auto &closer : m_segmentClosers ) {
+		closer.wait();
+	}
+	m_segmentClosers.clear();
+
+	const bool isFinalized = closeEncoder( m_encoder );
+
+	std::vector<std::promise<bool>> promises;
+	std::vector<std::function<void( bool )>> callbacks;
+	{
+		std::lock_guard<std::mutex> lock( m_finalizeMutex );
+		promises.swap( m_finalizePromises );
+		callbacks.swap( m_finalizeCallbacks );
+		m_isEncoderOpen = false;
+	}
+
+	for ( auto &promise : promises ) promise.set_value( isFinalized );
+	for ( auto &callback : callbacks ) callback( isFinalized );
 }
 
 // -----------------------------------------------------------------
-void Recorder::stop()
+void Recorder::processPrewarm()
 {
-	m_isRecording = false;
+	static std::atomic<int> counter { 0 };
+
+	std::unique_lock<std::mutex> lock( m_prewarmMutex );
+
+	while ( !m_isPrewarmThreadExiting ) {
+
+		if ( m_prewarmed.size() >= m_nPrewarm ) {
+			m_prewarmCondition.wait( lock );
+			continue;
+		}
+
+		// spawn next to where the template records, so the final move is a cheap rename
+		const RecorderSettings settings = m_prewarmSettings;
+		const std::string outputPath    = ofFilePath::join( ofFilePath::getEnclosingDirectory( settings.outputPath, false ),
+                                                         "." + ofFilePath::getBaseName( settings.outputPath ) + ".prewarm-" + std::to_string( counter++ ) + "." + ofFilePath::getFileExt( settings.outputPath ) );
+
+		lock.unlock();
+		EncoderProcess encoder;
+		const bool isSpawned = spawnEncoder( settings, outputPath, encoder );
+		lock.lock();
+
+		if ( !isSpawned ) {
+			// don't spin on a broken ffmpeg path
+			m_prewarmCondition.wait_for( lock, std::chrono::seconds( 1 ) );
+		} else if ( m_isPrewarmThreadExiting || !isPrewarmCompatible( settings, m_prewarmSettings ) ) {
+			lock.unlock();
+			discardEncoder( encoder );
+			lock.lock();
+		} else {
+			m_prewarmed.push_back( encoder );
+		}
+	}
+
+	// release anything spawned since prewarm( ..., 0 ) emptied the pool
+	std::vector<EncoderProcess> released;
+	released.swap( m_prewarmed );
+	lock.unlock();
+
+	for ( auto &encoder : released ) {
+		discardEncoder( encoder );
+	}
 }
 
+// -----------------------------------------------------------------
 bool Recorder::wantsFrame()
 {
-	if ( m_isRecording && m_ffmpegPipe ) {
-		const float delta          = Seconds( Clock::now() - m_recordStartTime ).count() - getRecordedDuration();
-		const size_t framesToWrite = delta * m_settings.fps;
-		return framesToWrite > 0;
+	if ( m_isRecording && m_isEncoderOpen && !m_isPaused ) {
+		if ( m_nAddedFrames == 0 ) return true;
+		const float delta = Seconds( Clock::now() - m_recordStartTime.load() ).count() - getRecordedDuration();
+		return delta * m_settings.fps >= 1.f;
 	}
 	return false;
 }
@@ -129,12 +812,20 @@ bool Recorder::wantsFrame()
 // -----------------------------------------------------------------
 size_t Recorder::addFrame( const ofPixels &pixels )
 {
+	if ( m_isPreRolling && !m_isRecording ) {
+		return addPreRollFrame( pixels );
+	}
+
+	if ( m_isStarting ) {
+		return 0;  // startAsync() hasn't finished yet
+	}
+
 	if ( !m_isRecording ) {
 		LOG_ERROR() << "Can't add new frame - not in recording mode.";
 		return 0;
 	}
 
-	if ( !m_ffmpegPipe ) {
+	if ( !m_isEncoderOpen ) {
 		LOG_ERROR() << "Can't add new frame - FFmpeg pipe is invalid!";
 		return 0;
 	}
@@ -144,95 +835,871 @@ size_t Recorder::addFrame( const ofPixels &pixels )
 		return 0;
 	}
 
+	if ( m_isPaused ) {
+		return 0;
+	}
+
+	m_tracer.record( TraceEvent::Submit, m_nAddedFrames );
+
 	if ( m_nAddedFrames == 0 ) {
 		if ( m_thread.joinable() ) m_thread.join();  //detach();
 		m_thread          = std::thread( &Recorder::processFrame, this );
 		m_recordStartTime = Clock::now();
-		m_lastFrameTime   = m_recordStartTime;
+		m_lastFrameTime   = m_recordStartTime.load();
+		m_hasVideoStarted = true;  // audio is accepted from here on, so both streams share the same start time
 	}
 
 	// add new frame(s) at specified frame rate
-	const float delta          = Seconds( Clock::now() - m_recordStartTime ).count() - getRecordedDuration();
-	const size_t framesToWrite = delta * m_settings.fps;
+	const float delta          = Seconds( Clock::now() - m_recordStartTime.load() ).count() - getRecordedDuration();
+	const size_t framesToWrite = m_nAddedFrames == 0 ? 1 : size_t( std::max( 0.f, delta * m_settings.fps ) );  // the first frame is always taken
 	size_t written             = 0;
 	ofPixels *pixPtr           = nullptr;
 
 	// drop or duplicate frames to maintain constant framerate
-	while ( m_nAddedFrames == 0 || framesToWrite > written ) {
+	while ( framesToWrite > written ) {
 
 		if ( !pixPtr ) {
 			pixPtr = new ofPixels( pixels );  // copy pixel data
+			m_tracer.record( TraceEvent::CopyDone, m_nAddedFrames );
 		}
 
 		if ( written == framesToWrite - 1 ) {
 			// only the last frame we produce owns the pixel data
-			m_frames.produce( pixPtr );
+			m_queuedBytes += pixPtr->getTotalBytes();
+			m_frames.produce( { pixPtr, true, m_nAddedFrames } );
 		} else {
 			// otherwise, we reference the data
 			ofPixels *pixRef = new ofPixels();
 			pixRef->setFromExternalPixels( pixPtr->getData(), pixPtr->getWidth(), pixPtr->getHeight(), pixPtr->getPixelFormat() );  // re-use already copied pointer
-			m_frames.produce( pixRef );
+			m_frames.produce( { pixRef, false, m_nAddedFrames } );
 		}
+		m_tracer.record( TraceEvent::Queued, m_nAddedFrames );
 
 		++m_nAddedFrames;
 		++written;
 		m_lastFrameTime = Clock::now();
 	}
 
+	if ( written == 0 ) {
+		++m_nDroppedFrames;
+	} else {
+		++m_nUniqueFrames;
+		m_nDuplicatedFrames += written - 1;
+	}
+
 	return written;
 }
 
 // -----------------------------------------------------------------
-void Recorder::processFrame()
+size_t Recorder::addAudio( const ofSoundBuffer &buffer )
 {
-	while ( isRecording() ) {
-
-		TimePoint lastFrameTime = Clock::now();
-		const float framedur    = 1.f / m_settings.fps;
+	// called from the sound callback - no logging, locking or allocating in here
 
-		while ( m_frames.size() ) {  // allows finish processing queue after we call stop()
+	if ( !m_isRecording || !m_settings.recordAudio || !m_hasVideoStarted || m_isPaused ) {
+		return 0;
+	}
 
-			// feed frames at constant fps
-			float delta = Seconds( Clock::now() - lastFrameTime ).count();
+	const size_t nChannels = m_settings.audioChannels;
+	if ( buffer.getNumChannels() != nChannels ) {
+		return 0;
+	}
 
-			if ( delta >= framedur ) {
+	// only write whole sample frames, so channels never get out of step
+	const size_t nFrames   = buffer.getNumFrames();
+	const size_t nBuffered = std::min( nFrames, m_audioSamples.getFreeSpace() / nChannels );
+	m_audioSamples.write( buffer.getBuffer().data(), nBuffered * nChannels );
 
-				if ( !isRecording() ) {
-					LOG_VERBOSE() << "Recording stopped, but finishing frame queue - " << m_frames.size() << " remaining frames at " << m_settings.fps << " fps";
-				}
+	const uint64_t nReceived = m_audioSamplesReceived += nFrames;
+	if ( nBuffered < nFrames ) {
+		m_audioOverruns += nFrames - nBuffered;
+	}
 
-				ofPixels *pixels = nullptr;
+	// measure the sound card clock against the frame clock (both start with the first video frame)
+	const double audioTime = ( nReceived + m_audioLeadIn ) / double( m_settings.audioSampleRate );
+	const double videoTime = std::chrono::duration<double>( Clock::now() - m_recordStartTime.load() ).count();
+	const double drift     = audioTime - videoTime;
 
-				if ( m_frames.consume( pixels ) && pixels ) {
-					const unsigned char *data = pixels->getData();
-					const size_t dataLength   = m_settings.videoResolution.x * m_settings.videoResolution.y * 3;
-					const size_t written      = m_ffmpegPipe ? fwrite( data, sizeof( char ), dataLength, m_ffmpegPipe ) : 0;
+	if ( nReceived == nFrames ) {
+		m_audioDriftOrigin = drift;  // the first callback's offset is latency, not drift
+	}
+	m_audioDrift = drift;
+	if ( videoTime > 1. ) {
+		m_audioDriftRate = ( drift - m_audioDriftOrigin ) / videoTime;
+	}
 
-					if ( written <= 0 ) {
-						LOG_WARNING() << "Unable to write the frame.";
-					}
+	return nBuffered;
+}
 
-					pixels->clear();
-					delete pixels;
+// -----------------------------------------------------------------
+AudioStats Recorder::getAudioStats() const
+{
+	AudioStats stats;
+	stats.samplesReceived = m_audioSamplesReceived.load( std::memory_order_relaxed );
+	stats.samplesWritten  = m_audioSamplesWritten.load( std::memory_order_relaxed );
+	stats.overruns        = m_audioOverruns.load( std::memory_order_relaxed );
+	stats.underruns       = m_audioUnderruns.load( std::memory_order_relaxed );
+	stats.drift           = m_audioDrift.load( std::memory_order_relaxed ) - m_audioDriftOrigin.load( std::memory_order_relaxed );
+	stats.driftRate       = m_audioDriftRate.load( std::memory_order_relaxed );
+	stats.resampleRatio   = m_audioResampleRatio.load( std::memory_order_relaxed );
+	return stats;
+}
 
-					lastFrameTime = Clock::now();
+// -----------------------------------------------------------------
+RecorderStats Recorder::getStats() const
+{
+	RecorderStats stats;
+	stats.framesAdded      = m_nUniqueFrames.load( std::memory_order_relaxed );
+	stats.framesDuplicated = m_nDuplicatedFrames.load( std::memory_order_relaxed );
+	stats.framesDropped    = m_nDroppedFrames.load( std::memory_order_relaxed );
+	stats.framesWritten    = m_nWrittenFrames.load( std::memory_order_relaxed );
+	stats.framesDiscarded  = m_nDiscardedFrames.load( std::memory_order_relaxed );
+	stats.queuedFrames     = std::max( 0, m_frames.size() );
+	stats.queuedBytes      = m_queuedBytes.load( std::memory_order_relaxed );
+	stats.bytesWritten     = m_bytesWritten.load( std::memory_order_relaxed );
+	stats.writeLatencyP50  = m_writeLatency.getPercentile( 0.5f ).count();
+	stats.writeLatencyP99  = m_writeLatency.getPercentile( 0.99f ).count();
+	stats.writeLatencyMax  = m_writeLatency.getMax().count();
+	stats.writerIdleTime   = m_writerIdleTime.load( std::memory_order_relaxed );
+	stats.startStall       = m_startStall.load( std::memory_order_relaxed );
+	stats.timeToFirstFrame = m_timeToFirstFrame.load( std::memory_order_relaxed );
+	stats.usedPrewarmed    = m_usedPrewarmed.load( std::memory_order_relaxed );
+	stats.pausedTime       = m_pausedTime.load( std::memory_order_relaxed );
+	stats.restarts         = m_nRestarts.load( std::memory_order_relaxed );
+	stats.stalls           = m_nStalls.load( std::memory_order_relaxed );
+	stats.stallTime        = m_stallTime.load( std::memory_order_relaxed );
+	stats.segments         = m_nSegments.load( std::memory_order_relaxed );
+	stats.replayDuration   = m_replay.getDuration();
+	stats.replayBytes      = m_replay.getNumBytes();
+	stats.audio            = getAudioStats();
+
+	if ( m_hasVideoStarted ) {
+		const double elapsed = std::chrono::duration<double>( m_lastWriteTime.load() - m_recordStartTime.load() ).count();
+		stats.bytesPerSecond = elapsed > 0. ? stats.bytesWritten / elapsed : 0.;
+	}
+
+	return stats;
+}
+
+// -----------------------------------------------------------------
+void Recorder::processFrame()
+{
+	const auto frameDuration = std::chrono::duration_cast<Clock::duration>( Seconds( 1.f / m_settings.fps ) );
+	TimePoint idleStart      = Clock::now();
+	TimePoint nextFrameTime  = idleStart;
+
+	while ( isRecording() || m_frames.size() ) {  // allows finish processing queue after we call stop()
+
+		if ( !isRecording() && Clock::now() > m_flushDeadline.load() ) {
+			LOG_WARNING() << "Flush timeout expired, discarding " << m_frames.size() << " queued frames.";
+			discardQueuedFrames();
+			break;
+		}
+
+		// sleep rather than spin while waiting for a frame
+		if ( m_frames.size() == 0 ) {
+			std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+			continue;
+		}
+
+		if ( m_isDrainingBacklog && m_frames.size() <= 1 ) {
+			m_isDrainingBacklog = false;  // caught up with live frames
+		}
+
+		// feed frames at constant fps - slots are scheduled from the previous slot, not from when the previous write
+		// finished, otherwise write time adds up and the writer falls behind the frames addFrame() produces
+		const TimePoint now = Clock::now();
+		if ( now < nextFrameTime && !m_isDrainingBacklog ) {
+			std::this_thread::sleep_until( nextFrameTime );
+			continue;
+		}
+		nextFrameTime = std::max( nextFrameTime + frameDuration, now - frameDuration );  // catch up on a backlog, but don't bank idle time
+
+		if ( !isRecording() ) {
+			LOG_VERBOSE() << "Recording stopped, but finishing frame queue - " << m_frames.size() << " remaining frames at " << m_settings.fps << " fps";
+		}
+
+		Frame frame;
+
+		if ( m_frames.consume( frame ) && frame.pixels ) {
+			m_tracer.record( TraceEvent::Dequeued, frame.index );
+
+			ofPixels *pixels         = frame.pixels;
+			const size_t dataLength  = m_settings.videoResolution.x * m_settings.videoResolution.y * 3;
+			const size_t queuedBytes = frame.encoded ? frame.encoded->size() : pixels->getTotalBytes();
+
+			if ( frame.encoded ) {
+				if ( !ofLoadImage( *pixels, *frame.encoded ) || pixels->getTotalBytes() != dataLength ) {
+					LOG_WARNING() << "Unable to decode a pre-roll frame, writing a black frame instead.";
+					pixels->allocate( m_settings.videoResolution.x, m_settings.videoResolution.y, OF_PIXELS_RGB );
+					pixels->set( 0 );
+				}
+				delete frame.encoded;
+			}
+
+			for ( size_t i = 0; i < frame.repeat; ++i ) {
+				const unsigned char *data = pixels->getData();
+
+				m_tracer.record( TraceEvent::WriteBegin, frame.index + i );
+				const TimePoint writeStart = Clock::now();
+				const size_t written       = writeFrame( data, dataLength );
+				const TimePoint writeEnd   = Clock::now();
+				m_tracer.record( TraceEvent::WriteEnd, frame.index + i );
+
+				if ( written < dataLength ) {
+					LOG_WARNING() << "Unable to write the frame.";
+				} else {
+					m_nConsecutiveRestarts = 0;
+				}
+
+				m_writeLatency.add( writeEnd - writeStart );
+				m_writerIdleTime = m_writerIdleTime + Seconds( writeStart - idleStart ).count();
+				m_bytesWritten += written;
+				m_lastWriteTime = writeEnd;
+				if ( m_nWrittenFrames++ == 0 ) {
+					m_timeToFirstFrame = Seconds( writeEnd - m_startCallTime ).count();
+				}
+				idleStart = writeEnd;
+
+				// cut between two frames, so no frame is lost or written twice
+				++m_segmentFrames;
+				if ( isSegmentComplete() ) {
+					rotateSegment();
 				}
 			}
+
+			if ( frame.ownsData ) m_queuedBytes -= queuedBytes;
+			pixels->clear();
+			delete pixels;
+
+			// the queue was discarded during a stall, including the frame that owned these pixels
+			delete m_discardedInUse;
+			m_discardedInUse = nullptr;
 		}
 	}
 
 	// close ffmpeg pipe once stopped recording
+	m_nAddedFrames = 0;
+	finalizeOutput();
+}
 
-	if ( m_ffmpegPipe ) {
-		if ( P_CLOSE( m_ffmpegPipe ) < 0 ) {
-			// get error string from 'errno' code
-			char errmsg[500];
-			strerror_s( errmsg, 500, errno );
-			LOG_ERROR() << "Error closing FFmpeg pipe. Error: " << errmsg;
+// -----------------------------------------------------------------
+std::string Recorder::getSegmentPath( size_t index ) const
+{
+	return ofxFFmpeg::getSegmentPath( m_settings, index );
+}
+
+// -----------------------------------------------------------------
+bool Recorder::isSegmentComplete() const
+{
+	if ( m_settings.segmentDuration > 0.f && m_segmentFrames >= std::max( 1.f, std::round( m_settings.segmentDuration * m_settings.fps ) ) ) {
+		return true;
+	}
+
+	// ffmpeg writes as it encodes, so the file on disk trails the stream by its internal buffering - checked a few times a second
+	const uint64_t checkInterval = std::max( 1.f, m_settings.fps / 4.f );
+	if ( m_settings.segmentSize > 0 && m_segmentFrames % checkInterval == 0 ) {
+		return ofFile( m_encoder.outputPath, ofFile::Reference, false ).getSize() >= m_settings.segmentSize;
+	}
+
+	return false;
+}
+
+// -----------------------------------------------------------------
+void Recorder::prepareNextSegment()
+{
+	const RecorderSettings settings = m_settings;
+	const std::string outputPath    = getSegmentPath( m_nSegments );
+
+	// spawn now, so the switch doesn't wait for ffmpeg to start
+	m_nextEncoder = std::async( std::launch::async, [settings, outputPath]() {
+		EncoderProcess encoder;
+		if ( !spawnEncoder( settings, outputPath, encoder ) ) encoder = EncoderProcess();
+		return encoder;
+	} );
+}
+
+// -----------------------------------------------------------------
+void Recorder::rotateSegment()
+{
+	EncoderProcess next = m_nextEncoder.valid() ? m_nextEncoder.get() : EncoderProcess();
+
+	if ( !next.pipe ) {
+		// rather a long segment than a gap - try again at the next boundary
+		LOG_ERROR() << "Unable to start the next segment, continuing " << m_encoder.finalPath;
+		m_segmentFrames = 0;
+		prepareNextSegment();
+		return;
+	}
+
+	LOG_VERBOSE() << "Segment " << m_encoder.finalPath << " complete after " << m_segmentFrames << " frames, continuing with " << next.finalPath;
+
+	EncoderProcess previous = m_encoder;
+	m_encoder               = next;
+	m_segmentFrames         = 0;
+	++m_nSegments;
+	addOutputFile( m_encoder.finalPath );
+
+	// closers of earlier segments that are done are reaped here, so a recording rotating for days doesn't pile up threads
+	for ( auto it = m_segmentClosers.begin(); it != m_segmentClosers.end(); ) {
+		const bool isDone = it->wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready;
+		it                = isDone ? m_segmentClosers.erase( it ) : std::next( it );
+	}
+
+	// ffmpeg can take a while to write the trailer, the writer carries on meanwhile
+	m_segmentClosers.push_back( std::async( std::launch::async, [previous]() mutable {
+		closeEncoder( previous );
+	} ) );
+
+	prepareNextSegment();
+}
+
+// -----------------------------------------------------------------
+bool Recorder::startPreRoll( const RecorderSettings &settings )
+{
+	if ( isRecording() || isStarting() ) {
+		LOG_WARNING() << "Can't start pre-roll - already recording.";
+		return false;
+	}
+
+	if ( settings.preRollDuration <= 0.f || settings.fps <= 0.f ) {
+		LOG_ERROR() << "Can't start pre-roll - preRollDuration and fps must be > 0.";
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock( m_preRollMutex );
+	releasePreRoll();
+
+	// one slot per frame, so the ring holds preRollDuration even when every addFrame() call is taken
+	const size_t nSlots = std::ceil( settings.preRollDuration * settings.fps );
+	m_preRoll.resize( nSlots );
+	for ( auto &slot : m_preRoll ) {
+		if ( settings.preRollCompression ) {
+			slot.encoded = new ofBuffer();
+		} else {
+			slot.pixels = new ofPixels();
+			slot.pixels->allocate( settings.videoResolution.x, settings.videoResolution.y, OF_PIXELS_RGB );
 		}
 	}
 
-	m_ffmpegPipe   = nullptr;
-	m_nAddedFrames = 0;
+	m_preRollSettings = settings;
+	m_preRollHead     = 0;
+	m_preRollSize     = 0;
+	m_nPreRollFrames  = 0;
+	m_nPreRollAdded   = 0;
+	m_isPreRolling    = true;
+
+	LOG_VERBOSE() << "Pre-rolling " << settings.preRollDuration << " seconds in " << nSlots << ( settings.preRollCompression ? " compressed" : "" ) << " slots.";
+	return true;
+}
+
+// -----------------------------------------------------------------
+void Recorder::stopPreRoll()
+{
+	std::lock_guard<std::mutex> lock( m_preRollMutex );
+	m_isPreRolling = false;
+	releasePreRoll();
+}
+
+// -----------------------------------------------------------------
+float Recorder::getPreRollDuration() const
+{
+	std::lock_guard<std::mutex> lock( m_preRollMutex );
+	return m_isPreRolling ? m_nPreRollFrames / m_preRollSettings.fps : 0.f;
+}
+
+// -----------------------------------------------------------------
+size_t Recorder::addPreRollFrame( const ofPixels &pixels )
+{
+	std::lock_guard<std::mutex> lock( m_preRollMutex );
+
+	if ( !m_isPreRolling ) {
+		return 0;  // start() flushed the ring meanwhile
+	}
+
+	const glm::ivec2 &resolution = m_preRollSettings.videoResolution;
+	if ( pixels.getWidth() != size_t( resolution.x ) || pixels.getHeight() != size_t( resolution.y ) || pixels.getNumChannels() != 3 ) {
+		LOG_ERROR() << "Can't add pre-roll frame - pixels must be RGB at " << resolution.x << "x" << resolution.y;
+		return 0;
+	}
+
+	// same frame clock as addFrame(), counted from the first pre-roll frame
+	const TimePoint now = Clock::now();
+	if ( m_nPreRollAdded == 0 ) {
+		m_preRollStartTime = now;
+	}
+	const uint64_t frameIndex = Seconds( now - m_preRollStartTime ).count() * m_preRollSettings.fps;
+	const size_t repeat       = m_nPreRollAdded == 0 ? 1 : frameIndex + 1 - std::min( frameIndex + 1, m_nPreRollAdded );
+	if ( repeat == 0 ) {
+		return 0;
+	}
+
+	// reuse the oldest slot once the ring is full
+	const size_t capacity = m_preRoll.size();
+	if ( m_preRollSize == capacity ) {
+		m_nPreRollFrames -= m_preRoll[m_preRollHead].repeat;
+		m_preRollHead = ( m_preRollHead + 1 ) % capacity;
+		--m_preRollSize;
+	}
+
+	PreRollSlot &slot = m_preRoll[( m_preRollHead + m_preRollSize ) % capacity];
+	if ( slot.encoded ) {
+		ofSaveImage( pixels, *slot.encoded, OF_IMAGE_FORMAT_JPEG, m_preRollSettings.preRollQuality );
+	} else {
+		slot.pixels->setFromPixels( pixels.getData(), resolution.x, resolution.y, OF_PIXELS_RGB );  // same size, no allocation
+	}
+	slot.repeat = repeat;
+	++m_preRollSize;
+	m_nPreRollFrames += repeat;
+	m_nPreRollAdded += repeat;
+
+	// drop slots that fell out of the window
+	while ( m_preRollSize > 1 && m_nPreRollFrames - m_preRoll[m_preRollHead].repeat >= capacity ) {
+		m_nPreRollFrames -= m_preRoll[m_preRollHead].repeat;
+		m_preRollHead = ( m_preRollHead + 1 ) % capacity;
+		--m_preRollSize;
+	}
+
+	return repeat;
+}
+
+// -----------------------------------------------------------------
+void Recorder::flushPreRoll()
+{
+	std::lock_guard<std::mutex> lock( m_preRollMutex );
+
+	if ( !m_isPreRolling.exchange( false ) || m_preRollSize == 0 ) {
+		releasePreRoll();
+		return;
+	}
+
+	if ( m_preRollSettings.videoResolution != m_settings.videoResolution || m_preRollSettings.fps != m_settings.fps ) {
+		LOG_WARNING() << "Pre-roll resolution or fps differ from the recording, discarding the pre-roll.";
+		releasePreRoll();
+		return;
+	}
+
+	// hand the pool's buffers over to the queue, nothing is copied or decoded here
+	for ( size_t i = 0; i < m_preRollSize; ++i ) {
+		PreRollSlot &slot = m_preRoll[( m_preRollHead + i ) % m_preRoll.size()];
+
+		Frame frame;
+		frame.pixels   = slot.pixels ? slot.pixels : new ofPixels();
+		frame.encoded  = slot.encoded;
+		frame.ownsData = true;
+		frame.index    = m_nAddedFrames;
+		frame.repeat   = slot.repeat;
+		slot.pixels    = nullptr;
+		slot.encoded   = nullptr;
+
+		m_queuedBytes += frame.encoded ? frame.encoded->size() : frame.pixels->getTotalBytes();
+		m_frames.produce( frame );
+
+		m_nAddedFrames += frame.repeat;
+		++m_nUniqueFrames;
+		m_nDuplicatedFrames += frame.repeat - 1;
+	}
+
+	LOG_VERBOSE() << "Flushing " << getRecordedDuration() << " seconds of pre-roll.";
+
+	// the recording clock starts where the pre-roll does, so live frames follow on without a gap
+	const TimePoint now = Clock::now();
+	m_recordStartTime   = now - std::chrono::duration_cast<Clock::duration>( Seconds( getRecordedDuration() ) );
+	m_lastFrameTime     = now;
+	m_audioLeadIn       = uint64_t( getRecordedDuration() * double( m_settings.audioSampleRate ) );
+	m_hasVideoStarted   = true;
+	m_isDrainingBacklog = true;
+
+	if ( m_thread.joinable() ) m_thread.join();
+	m_thread = std::thread( &Recorder::processFrame, this );
+
+	releasePreRoll();
+}
+
+// -----------------------------------------------------------------
+void Recorder::releasePreRoll()
+{
+	for ( auto &slot : m_preRoll ) {
+		delete slot.pixels;
+		delete slot.encoded;
+	}
+	m_preRoll.clear();
+	m_preRoll.shrink_to_fit();
+	m_preRollSize    = 0;
+	m_nPreRollFrames = 0;
+}
+
+// -----------------------------------------------------------------
+bool Recorder::startReplayBuffer( const RecorderSettings &settings )
+{
+	if ( isRecording() || isStarting() || m_isReadingReplay ) {
+		LOG_WARNING() << "Can't start replay buffer - already recording.";
+		return false;
+	}
+
+	if ( settings.replayDuration <= 0.f ) {
+		LOG_ERROR() << "Can't start replay buffer - replayDuration must be > 0.";
+		return false;
+	}
+
+	if ( m_replayThread.joinable() ) m_replayThread.join();
+
+	if ( !createOutputPipe( m_replayPipePath, m_replayPipe ) ) {
+		LOG_ERROR() << "Unable to create replay pipe: " << m_replayPipePath;
+		closeNamedPipe( m_replayPipePath, m_replayPipe );
+		m_replayPipePath.clear();
+		return false;
+	}
+
+	// same encoder, writing a transport stream into the pipe instead of a file
+	RecorderSettings replaySettings = settings;
+	replaySettings.outputPath       = m_replayPipePath;
+	replaySettings.extraOutputArgs += " -f mpegts";
+	replaySettings.allowOverwrite   = true;
+	replaySettings.segmentDuration  = 0.f;
+	replaySettings.segmentSize      = 0;
+
+	m_replay.setup( settings.replayDuration );
+
+	if ( !start( replaySettings ) ) {
+		closeNamedPipe( m_replayPipePath, m_replayPipe );
+		m_replayPipePath.clear();
+		return false;
+	}
+
+	m_isReadingReplay = true;
+	m_replayThread    = std::thread( &Recorder::processReplay, this );
+	return true;
+}
+
+// -----------------------------------------------------------------
+std::future<bool> Recorder::saveReplay( const std::string &path, float duration, std::function<void( bool )> onSaved )
+{
+	// join saves that have finished
+	for ( auto it = m_replaySaves.begin(); it != m_replaySaves.end(); ) {
+		if ( *it->isDone ) {
+			it->thread.join();
+			it = m_replaySaves.erase( it );
+		} else {
+			++it;
+		}
+	}
+
+	std::promise<bool> promise;
+	std::future<bool> future = promise.get_future();
+
+	// taken now, so the file ends at the trigger - writing and remuxing happen in the background
+	std::vector<PacketRing::Chunk> chunks = m_replay.getChunks( duration );
+	if ( chunks.empty() ) {
+		LOG_WARNING() << "Can't save replay - nothing buffered yet.";
+		promise.set_value( false );
+		if ( onSaved ) onSaved( false );
+		return future;
+	}
+
+	const std::string ffmpegPath = m_settings.ffmpegPath.empty() ? "ffmpeg" : m_settings.ffmpegPath;
+	auto isDone                  = std::make_shared<std::atomic<bool>>( false );
+	auto pid                     = std::make_shared<std::atomic<int>>( -1 );
+
+	std::thread thread( [chunks, path, ffmpegPath, onSaved, isDone, pid]( std::promise<bool> promise ) {
+		const bool isTransportStream = ofToLower( ofFilePath::getFileExt( path ) ) == "ts";
+		const std::string tsPath     = isTransportStream ? path : path + ".replay.ts";
+
+		bool isSaved = PacketRing::save( chunks, tsPath );
+
+		if ( isSaved && !isTransportStream ) {
+			const std::vector<std::string> args = {
+			    "-nostdin",                  // stdin isn't a terminal
+			    "-y",                        // overwrite
+			    "-loglevel error",           // only errors on stderr
+			    "-i " + quoteArg( tsPath ),  // the saved packets
+			    "-c copy",                   // remux without re-encoding
+			    quoteArg( path )             // output path
+			};
+
+			// the pid is kept, so the destructor can kill a remux that hangs
+			int processPid = -1;
+			FILE *pipe     = openProcess( joinArgs( ffmpegPath, args ), processPid, ProcessPipe::Stdout );
+			if ( pipe ) {
+				pid->store( processPid );
+				char buffer[256];  // ffmpeg writes the file itself, its stdout stays empty
+				while ( readProcess( pipe, reinterpret_cast<unsigned char *>( buffer ), sizeof( buffer ) ) > 0 ) {}
+				pid->store( -1 );
+			}
+			isSaved = pipe && closeProcess( pipe, processPid ) == 0;
+			ofFile::removeFile( tsPath, false );
+		}
+
+		if ( !isSaved ) {
+			LOG_ERROR() << "Unable to save replay to " << path;
+		}
+
+		promise.set_value( isSaved );
+		if ( onSaved ) onSaved( isSaved );
+		*isDone = true;
+	},
+	                    std::move( promise ) );
+
+	m_replaySaves.push_back( { std::move( thread ), isDone, pid } );
+	return future;
+}
+
+// -----------------------------------------------------------------
+void Recorder::processReplay()
+{
+	std::vector<char> buffer( PacketRing::PacketSize * 512 );
+	bool isConnected = false;
+
+	while ( true ) {
+		const int nRead = readOutputPipe( m_replayPipe, buffer.data(), buffer.size(), isConnected );
+
+		if ( nRead < 0 ) {
+			break;  // ffmpeg closed the stream, it's done
+		}
+
+		if ( nRead > 0 ) {
+			m_replay.push( buffer.data(), nRead );
+		} else if ( !isConnected ) {
+			if ( !m_isEncoderOpen ) {
+				LOG_WARNING() << "FFmpeg never opened the replay pipe.";
+				break;
+			}
+			std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+		}
+	}
+
+	closeNamedPipe( m_replayPipePath, m_replayPipe );
+	m_replayPipePath.clear();
+	m_isReadingReplay = false;
+}
+
+// -----------------------------------------------------------------
+size_t Recorder::writeFrame( const unsigned char *data, size_t size )
+{
+	const float timeout = m_settings.stallTimeout > 0.f ? m_settings.stallTimeout : -1.f;
+	size_t written      = 0;
+
+	while ( written < size && m_encoder.pipe ) {
+		bool isStalled = false;
+		written += writeProcess( m_encoder.pipe, data + written, size - written, timeout, isStalled );
+		if ( written == size ) {
+			break;
+		}
+
+		if ( !isStalled ) {
+			// ffmpeg died - carry on in a new process, starting with the frame it didn't get
+			if ( m_settings.restartOnFailure && restartEncoder() ) {
+				written = 0;
+				continue;
+			}
+			break;
+		}
+
+		// ffmpeg is alive, but hasn't read anything for a while
+		++m_nStalls;
+		m_stallTime = m_stallTime + timeout;
+		LOG_WARNING() << "FFmpeg hasn't consumed any data for " << timeout << " seconds, " << m_frames.size() << " frames queued.";
+
+		if ( m_settings.onStall ) {
+			m_settings.onStall();
+		}
+
+		if ( !isRecording() ) {
+			// stop() can't finish while ffmpeg doesn't read, give up on the remaining frames
+			LOG_ERROR() << "FFmpeg stalled while stopping, killing it and discarding " << m_frames.size() << " queued frames.";
+			killProcess( m_encoder.pid );
+			closeEncoder( m_encoder );
+			discardQueuedFrames( data );
+			break;
+		}
+
+		if ( m_settings.stallAction == StallAction::Restart ) {
+			killProcess( m_encoder.pid );
+			if ( !restartEncoder() ) break;
+			written = 0;
+		} else if ( m_settings.stallAction == StallAction::Drop ) {
+			discardQueuedFrames( data );  // memory stays flat while we keep waiting - data may belong to a queued frame
+		}
+	}
+
+	return written;
+}
+
+// -----------------------------------------------------------------
+bool Recorder::restartEncoder()
+{
+	if ( m_nConsecutiveRestarts >= m_settings.maxRestarts ) {
+		return false;
+	}
+	++m_nConsecutiveRestarts;
+	++m_nRestarts;
+
+	LOG_WARNING() << "FFmpeg stopped accepting frames for " << m_encoder.finalPath << ", restarting.";
+
+	// reap the dead process - with fragmented output its file is playable up to the last fragment
+	closeEncoder( m_encoder );
+
+	// the next segment's process would get the wrong file name now
+	if ( m_nextEncoder.valid() ) {
+		EncoderProcess next = m_nextEncoder.get();
+		discardEncoder( next );
+	}
+
+	const std::string outputPath = getSegmentPath( m_nSegments++ );
+	m_encoder                    = EncoderProcess();
+	m_segmentFrames              = 0;
+
+	if ( isSegmenting() ) {
+		prepareNextSegment();
+	}
+
+	if ( !spawnEncoder( m_settings, outputPath, m_encoder ) ) {
+		LOG_ERROR() << "Unable to restart ffmpeg for " << outputPath;
+		m_encoder = EncoderProcess();
+		return false;
+	}
+
+	addOutputFile( outputPath );
+	return true;
+}
+
+// -----------------------------------------------------------------
+void Recorder::addOutputFile( const std::string &path )
+{
+	m_outputFiles.push_back( path );
+	if ( m_outputFiles.size() < 2 ) {
+		return;
+	}
+
+	// concatenate with ffmpeg -f concat -i <manifest> -c copy <output>
+	const std::string &first       = m_outputFiles.front();
+	const std::string manifestPath = ofFilePath::removeExt( first ) + ".ffconcat";
+	const std::string manifestDir  = ofFilePath::getEnclosingDirectory( first, false );
+
+	std::ofstream manifest( manifestPath, std::ios::trunc );
+	manifest << "ffconcat version 1.0\n";
+	for ( const auto &file : m_outputFiles ) {
+		const bool isBeside = ofFilePath::getEnclosingDirectory( file, false ) == manifestDir;
+		manifest << "file '" << ( isBeside ? ofFilePath::getFileName( file, false ) : ofFilePath::getAbsolutePath( file, false ) ) << "'\n";
+	}
+
+	if ( !manifest.good() ) {
+		LOG_WARNING() << "Unable to write " << manifestPath;
+	}
+}
+
+// -----------------------------------------------------------------
+void Recorder::discardQueuedFrames( const unsigned char *inUse )
+{
+	Frame frame;
+	while ( m_frames.consume( frame ) ) {
+		if ( !frame.pixels ) continue;
+		if ( frame.ownsData ) m_queuedBytes -= frame.encoded ? frame.encoded->size() : frame.pixels->getTotalBytes();
+		m_nDiscardedFrames += frame.repeat;
+		delete frame.encoded;
+
+		// a duplicate being written references the data of the frame queued after it, which has to outlive the write
+		if ( inUse && frame.ownsData && frame.pixels->getData() == inUse ) {
+			m_discardedInUse = frame.pixels;
+			continue;
+		}
+		delete frame.pixels;
+	}
+}
+
+// -----------------------------------------------------------------
+void Recorder::processAudio()
+{
+	const size_t nChannels   = m_settings.audioChannels;
+	const double sampleRate  = m_settings.audioSampleRate;
+	const Seconds maxLatency = Seconds( 0.1f );  // how far audio may fall behind the recording clock before it counts as an underrun
+
+	const double maxRatioError = 0.01;   // never stretch by more than 1%, real clocks are off by a few hundred ppm at most
+	const double offsetGain    = 0.1;    // per second - removes a sync error over ~10 seconds
+	const double maxOffsetRate = 0.002;  // of the ratio spent on removing the sync error, so the pitch never bends audibly
+	const bool resample        = m_settings.audioDriftCorrection == AudioDriftCorrection::Resample;
+
+	std::vector<float> chunk( std::max<size_t>( m_settings.audioSampleRate / 100, 1 ) * nChannels );  // 10 ms of samples
+	std::vector<float> resampled( chunk.size() * ( 1. + maxRatioError ) + 2 * nChannels );
+	LinearResampler resampler;
+	resampler.setup( nChannels );
+	bool isConnected   = false, isStarved = false;
+	uint64_t nConsumed = 0;  // sample frames read from the ring, before resampling
+	TimePoint stopTime;
+
+	while ( isRecording() || ( isConnected && m_audioSamples.size() ) ) {
+
+		if ( !isConnected ) {
+			// ffmpeg opens the audio pipe once it has probed the video input
+			isConnected = connectAudioPipe( m_encoder.audioPipePath, m_encoder.audioPipe );
+
+			if ( !isConnected ) {
+				if ( !isRecording() ) {
+					if ( stopTime == TimePoint() ) stopTime = Clock::now();
+					if ( Clock::now() - stopTime > std::chrono::seconds( 2 ) ) {
+						LOG_WARNING() << "FFmpeg never opened the audio pipe, discarding " << m_audioSamples.size() / nChannels << " sample frames.";
+						break;
+					}
+				}
+				std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+				continue;
+			}
+		}
+
+		// silence under the pre-roll frames, which were captured before audio was accepted
+		if ( m_audioSamplesWritten < m_audioLeadIn ) {
+			const size_t nFrames = std::min<uint64_t>( chunk.size() / nChannels, m_audioLeadIn - m_audioSamplesWritten );
+			std::fill( chunk.begin(), chunk.end(), 0.f );
+			if ( !writeAudioPipe( m_encoder.audioPipe, chunk.data(), nFrames * nChannels ) ) {
+				LOG_WARNING() << "Unable to write audio samples.";
+			}
+			m_audioSamplesWritten += nFrames;
+			continue;
+		}
+
+		const size_t nSamples = m_audioSamples.read( chunk.data(), chunk.size() );
+
+		if ( nSamples == 0 ) {
+			if ( isRecording() && m_hasVideoStarted && !m_isPaused && !isStarved ) {
+				const Seconds written = Seconds( float( m_audioSamplesWritten.load() / sampleRate ) );
+				if ( Clock::now() - m_recordStartTime.load() - written > maxLatency ) {
+					++m_audioUnderruns;
+					isStarved = true;  // count each starvation once, not every poll
+				}
+			}
+			std::this_thread::sleep_for( std::chrono::milliseconds( 2 ) );
+			continue;
+		}
+
+		isStarved = false;
+
+		const float *samples = chunk.data();
+		size_t nFrames       = nSamples / nChannels;
+
+		if ( resample ) {
+			// a fast sound card clock delivers too many samples per video second, so squeeze them (and vice versa)
+			// the rate follows the clock speed, but the offset built up before the rate converged needs its own term -
+			// the consumed samples, minus the drift measured for them, is what the frame clock says should be written
+			const double drift   = m_audioDrift.load() - m_audioDriftOrigin.load();
+			const double target  = double( nConsumed ) - drift * sampleRate;
+			const double error   = ( double( m_audioSamplesWritten.load() - m_audioLeadIn ) - target ) / sampleRate;  // seconds of audio ahead of the frame clock
+			const double offset  = ofClamp( -offsetGain * error, -maxOffsetRate, maxOffsetRate );
+			const double ratio   = ofClamp( 1. / ( 1. + m_audioDriftRate.load() ) + offset, 1. - maxRatioError, 1. + maxRatioError );
+			m_audioResampleRatio = ratio;
+
+			nFrames = resampler.process( chunk.data(), nFrames, resampled.data(), ratio );
+			samples = resampled.data();
+		}
+		nConsumed += nSamples / nChannels;
+
+		if ( !writeAudioPipe( m_encoder.audioPipe, samples, nFrames * nChannels ) ) {
+			LOG_WARNING() << "Unable to write audio samples.";
+		}
+
+		m_audioSamplesWritten += nFrames;
+	}
+
+	// closing our end signals the end of the audio stream to ffmpeg
+	closeNamedPipe( m_encoder.audioPipePath, m_encoder.audioPipe );
+	m_isWritingAudio = false;
 }
-}  // namespace ofxFFmpeg
+}  // namespace ofxFFmpeg
\ No newline at end of file
@@ -1,19 +1,64 @@
 #pragma once
 #include "ofxFFmpegHelpers.h"
+#include "ofxFFmpegPacketRing.h"
+#include "ofxFFmpegPlayer.h"
+#include "ofxFFmpegPlaylist.h"
+#include "ofxFFmpegRawRecorder.h"
+#include "ofxFFmpegRecorderSettings.h"
+#include "ofxFFmpegSyncPlayer.h"
+#include "ofxFFmpegThumbnails.h"
+#include "ofxFFmpegTrace.h"
 
 namespace ofxFFmpeg {
 
-struct RecorderSettings
+struct AudioStats
 {
-	std::string outputPath      = "output.mp4";
-	glm::ivec2 videoResolution  = { 640, 480 };
-	float fps                   = 30.f;
-	unsigned int bitrate        = 20000;  // kbps
-	std::string videoCodec      = "libx264";
-	std::string extraInputArgs  = "";
-	std::string extraOutputArgs = "-pix_fmt yuv420p -vsync 1 -g 1";  // -crf 0 -preset ultrafast -tune zerolatency setpts='(RTCTIME - RTCSTART) / (TB * 1000000)'
-	bool allowOverwrite         = true;
-	std::string ffmpegPath      = "ffmpeg";
+	uint64_t samplesReceived = 0;  // sample frames pushed by addAudio()
+	uint64_t samplesWritten  = 0;  // sample frames written to ffmpeg
+	uint64_t overruns        = 0;  // sample frames dropped because the ring buffer was full
+	uint64_t underruns       = 0;  // times the writer ran dry while the recording clock kept going
+	double drift             = 0.;  // seconds the sound card clock is ahead (+) or behind (-) the video frame clock
+	double driftRate         = 0.;  // drift per second of recording, i.e. the relative clock speed error
+	double resampleRatio     = 1.;  // output / input samples currently applied by AudioDriftCorrection::Resample
+};
+
+struct RecorderStats
+{
+	uint64_t framesAdded      = 0;  // unique frames accepted by addFrame()
+	uint64_t framesDuplicated = 0;  // extra copies queued to keep a constant frame rate when addFrame() is called too slowly
+	uint64_t framesDropped    = 0;  // frames passed to addFrame() that were not needed, because it's called faster than the frame rate
+	uint64_t framesWritten    = 0;  // frames piped to ffmpeg
+	uint64_t framesDiscarded  = 0;  // queued frames thrown away because stop()'s flush timeout expired
+	size_t queuedFrames       = 0;  // frames waiting for the writer
+	size_t queuedBytes        = 0;  // pixel memory held by the queue (duplicates share their data)
+	uint64_t bytesWritten     = 0;
+	double bytesPerSecond     = 0.;  // average pipe throughput since recording started
+	float writeLatencyP50     = 0.f;  // seconds per frame write
+	float writeLatencyP99     = 0.f;
+	float writeLatencyMax     = 0.f;
+	float writerIdleTime      = 0.f;  // seconds the writer spent waiting for frames or for its next frame slot
+	float startStall          = 0.f;  // seconds start() blocked the calling thread
+	float timeToFirstFrame    = 0.f;  // seconds from start() until the first frame was piped to ffmpeg
+	bool usedPrewarmed        = false;  // start() claimed a pre-warmed process
+	float pausedTime          = 0.f;  // seconds spent paused, not part of the recording
+	uint64_t restarts         = 0;  // times ffmpeg died or stalled and was respawned
+	uint64_t stalls           = 0;  // times ffmpeg read nothing for stallTimeout
+	float stallTime           = 0.f;  // seconds spent stalled
+	uint64_t segments         = 0;  // files started so far, including the one being written
+	float replayDuration      = 0.f;  // seconds held by the replay buffer
+	size_t replayBytes        = 0;
+	AudioStats audio;
+};
+
+// a spawned ffmpeg process, waiting for (or receiving) frames
+struct EncoderProcess
+{
+	FILE* pipe = nullptr;
+	std::string outputPath;  // where ffmpeg writes - a temporary path for pre-warmed processes
+	std::string finalPath;   // where the file goes once ffmpeg has finalized it
+	std::string audioPipePath;
+	intptr_t audioPipe = -1;  // fd on posix, HANDLE on windows
+	int pid            = -1;  // posix only
 };
 
 class Recorder
@@ -23,27 +68,179 @@ public:
 	~Recorder();
 
 	bool start( const RecorderSettings& settings );
-	void stop();
+	void stop( float flushTimeout = -1.f );  // seconds to keep piping queued frames, after which they're discarded - < 0 pipes them all
+
+	// freezes the recording clock, ffmpeg keeps running - call from the thread that calls addFrame()
+	// addFrame() and addAudio() ignore their input until resume(), which continues the timestamps where they left off
+	void pause();
+	void resume();
+
+	// non-blocking versions - process creation and finalization happen on background threads
+	// callbacks are called from those threads, when the future resolves
+	// stopping while startAsync() is still pending stops as soon as it has started, or resolves false if it failed
+	std::future<bool> startAsync( const RecorderSettings& settings, std::function<void( bool )> onStarted = nullptr );  // resolves once ffmpeg accepts frames
+	std::future<bool> stopAsync( float flushTimeout = -1.f, std::function<void( bool )> onFinished = nullptr );        // resolves once the file is finalized
+
+	// keeps count idle ffmpeg processes spawned in the background for settings like these, so start() with settings that
+	// only differ in outputPath claims one instead of spawning ffmpeg on the calling thread - pass 0 to release them
+	void prewarm( const RecorderSettings& settings, size_t count = 1 );
+	size_t getNumPrewarmed() const;
+
+	// keeps the last preRollDuration seconds of addFrame() in a pool allocated up front, without running ffmpeg - the next
+	// start() with the same resolution and fps writes them ahead of the live frames, so the file begins before the trigger
+	// pre-roll ends with that start(), call startPreRoll() again after stop() to keep buffering
+	bool startPreRoll( const RecorderSettings& settings );
+	void stopPreRoll();  // drops the buffered frames and frees the pool
+	bool isPreRolling() const { return m_isPreRolling.load(); }
+	float getPreRollDuration() const;  // seconds currently buffered
+
+	// runs ffmpeg continuously, encoding addFrame() to MPEG-TS in memory, and keeps the last replayDuration seconds as
+	// whole GOPs - saveReplay() writes them to disk without re-encoding. Bound the GOP length with -g in extraOutputArgs
+	// (the default -g 1 keeps every frame a keyframe, which costs a lot of memory). End it with stop().
+	bool startReplayBuffer( const RecorderSettings& settings );
+	// .ts files are written as is, other formats are remuxed by ffmpeg - duration < 0 saves everything buffered
+	// the buffer keeps running and can be saved again, also after stop()
+	std::future<bool> saveReplay( const std::string& path, float duration = -1.f, std::function<void( bool )> onSaved = nullptr );
+	bool isReplayBuffering() const { return m_isReadingReplay.load(); }
 
 	bool wantsFrame();	// returns true if recorder is ready for new frame
 	size_t addFrame( const ofPixels& pixels );  // returns the number of frames added to queue
+	size_t addAudio( const ofSoundBuffer& buffer );  // realtime safe, call from audioIn() - returns the number of sample frames buffered
 
 	bool isRecording() const { return m_isRecording.load(); }
-	bool isReady() const { return m_isRecording.load() == false && m_frames.size() == 0; }
+	bool isStarting() const { return m_isStarting.load(); }
+	bool isPaused() const { return m_isPaused.load(); }
+	bool isReady() const { return m_isRecording.load() == false && !m_isStarting.load() && !m_isEncoderOpen.load() && m_frames.size() == 0 && !m_isWritingAudio.load(); }
 	float getRecordedDuration() const { return m_nAddedFrames / m_settings.fps; }
 
 	const RecorderSettings& getSettings() const { return m_settings; }
+	std::string getSegmentPath( size_t index ) const;  // output file of the index-th segment
+	AudioStats getAudioStats() const;
+	RecorderStats getStats() const;  // cheap snapshot, safe to call from any thread
+	Tracer& getTracer() { return m_tracer; }  // enable to record per-frame lifecycle events, save as Chrome trace JSON
 
 protected:
 	RecorderSettings m_settings;
-	std::atomic<bool> m_isRecording;
-	FILE* m_ffmpegPipe;
-	TimePoint m_recordStartTime, m_lastFrameTime;
-	unsigned int m_nAddedFrames;
+	std::atomic<bool> m_isRecording { false }, m_isStarting { false };
+	std::atomic<bool> m_isEncoderOpen { false };  // until ffmpeg has exited and the file is finalized
+	std::atomic<bool> m_isPaused { false };
+	TimePoint m_pauseTime;
+	std::atomic<float> m_pausedTime { 0.f };
+	std::atomic<TimePoint> m_flushDeadline { TimePoint::max() };
+	EncoderProcess m_encoder;
+	std::thread m_startThread;
+	std::mutex m_finalizeMutex;  // also guards m_isStarting changing while a stop is queued behind it
+	std::vector<std::promise<bool>> m_finalizePromises;
+	std::vector<std::function<void( bool )>> m_finalizeCallbacks;
+	bool m_isStopPending        = false;  // stop() was called while startAsync() was still starting
+	float m_pendingFlushTimeout = -1.f;
+	std::vector<std::promise<bool>> m_pendingStopPromises;  // stopAsync() calls waiting for startAsync() to finish
+	std::vector<std::function<void( bool )>> m_pendingStopCallbacks;
+	std::atomic<TimePoint> m_recordStartTime { TimePoint() };  // shifted by resume(), read by the sound callback, the writers and getStats()
+	TimePoint m_lastFrameTime;
+	unsigned int m_nAddedFrames = 0;
 	std::thread m_thread;
-	LockFreeQueue<ofPixels*> m_frames;
+
+	struct Frame
+	{
+		ofPixels* pixels  = nullptr;
+		bool ownsData     = false;  // duplicates reference the pixel data of the frame queued after them
+		uint64_t index    = 0;
+		size_t repeat     = 1;        // times the writer pipes the pixels
+		ofBuffer* encoded = nullptr;  // compressed pre-roll frame, decoded into pixels by the writer
+	};
+	LockFreeQueue<Frame> m_frames;
+	ofPixels* m_discardedInUse = nullptr;  // pixels discarded while the writer still pipes a duplicate referencing them
+
+	// stats
+	std::atomic<uint64_t> m_nUniqueFrames { 0 }, m_nDuplicatedFrames { 0 }, m_nDroppedFrames { 0 }, m_nWrittenFrames { 0 }, m_nDiscardedFrames { 0 };
+	std::atomic<uint64_t> m_queuedBytes { 0 }, m_bytesWritten { 0 };
+	std::atomic<float> m_writerIdleTime { 0.f };
+	std::atomic<TimePoint> m_lastWriteTime { TimePoint() };
+	TimePoint m_startCallTime;
+	std::atomic<float> m_startStall { 0.f }, m_timeToFirstFrame { 0.f };
+	std::atomic<bool> m_usedPrewarmed { false };
+	LatencyHistogram m_writeLatency;
+	Tracer m_tracer;
+
+	// audio
+	std::atomic<bool> m_hasVideoStarted { false }, m_isWritingAudio { false };
+	std::atomic<uint64_t> m_audioSamplesReceived { 0 }, m_audioSamplesWritten { 0 }, m_audioOverruns { 0 }, m_audioUnderruns { 0 };
+	std::atomic<double> m_audioDrift { 0. }, m_audioDriftOrigin { 0. }, m_audioDriftRate { 0. }, m_audioResampleRatio { 1. };
+	RingBuffer<float> m_audioSamples;
+	std::thread m_audioThread;
+
+	// pre-warmed processes
+	RecorderSettings m_prewarmSettings;
+	size_t m_nPrewarm = 0;
+	std::vector<EncoderProcess> m_prewarmed;
+	mutable std::mutex m_prewarmMutex;
+	std::condition_variable m_prewarmCondition;
+	std::thread m_prewarmThread;
+	bool m_isPrewarmThreadExiting = false;
+
+	// segments - only touched by the writer thread, apart from the counter
+	std::atomic<uint64_t> m_nSegments { 0 };
+	uint64_t m_segmentFrames = 0;
+	std::future<EncoderProcess> m_nextEncoder;  // spawned while the current segment is still being written
+	std::vector<std::future<void>> m_segmentClosers;  // finalizing completed segments, reaped at each rotation
+	std::vector<std::string> m_outputFiles;           // of this recording, in order
+	std::atomic<uint64_t> m_nRestarts { 0 }, m_nStalls { 0 };
+	std::atomic<float> m_stallTime { 0.f };
+	unsigned int m_nConsecutiveRestarts = 0;
+
+	// pre-roll
+	struct PreRollSlot
+	{
+		ofPixels* pixels  = nullptr;  // allocated at the video resolution, unless compressed
+		ofBuffer* encoded = nullptr;
+		size_t repeat     = 0;  // frames this slot stands for, > 1 when addFrame() is called slower than the frame rate
+	};
+	RecorderSettings m_preRollSettings;
+	std::vector<PreRollSlot> m_preRoll;  // used as a ring
+	size_t m_preRollHead = 0, m_preRollSize = 0;  // oldest slot, slots in use
+	uint64_t m_nPreRollFrames = 0, m_nPreRollAdded = 0;  // frames in the ring / since startPreRoll(), counting repeats
+	TimePoint m_preRollStartTime;
+	mutable std::mutex m_preRollMutex;
+	std::atomic<bool> m_isPreRolling { false };
+	std::atomic<bool> m_isDrainingBacklog { false };  // the writer doesn't pace itself until flushed pre-roll frames are written
+	uint64_t m_audioLeadIn = 0;  // sample frames of silence covering the pre-roll
+
+	// replay buffer
+	PacketRing m_replay;
+	std::string m_replayPipePath;  // ffmpeg writes its output here, read back by m_replayThread
+	intptr_t m_replayPipe = -1;
+	std::thread m_replayThread;
+	std::atomic<bool> m_isReadingReplay { false };
+	struct ReplaySave
+	{
+		std::thread thread;
+		std::shared_ptr<std::atomic<bool>> isDone;
+		std::shared_ptr<std::atomic<int>> pid;  // of the remuxing ffmpeg while it runs
+	};
+	std::vector<ReplaySave> m_replaySaves;  // finished ones are joined by the next saveReplay()
+
+	bool startEncoder( const RecorderSettings& settings, TimePoint startCallTime );
+	bool claimPrewarmed( EncoderProcess& encoder );
+	void finalizeOutput();  // closes the pipe once ffmpeg has all frames, moves pre-warmed output into place and resolves stopAsync()
+	void discardQueuedFrames( const unsigned char* inUse = nullptr );  // keeps the pixels of inUse, for the frame being written
+
+	size_t addPreRollFrame( const ofPixels& pixels );
+	void flushPreRoll();  // queues the buffered frames for the new encoder, and shifts the recording clock back to cover them
+	void releasePreRoll();
+
+	bool isSegmenting() const { return m_settings.segmentDuration > 0.f || m_settings.segmentSize > 0; }
+	bool isSegmentComplete() const;
+	void prepareNextSegment();
+	void rotateSegment();  // switches to the next encoder between two frames, the previous one is finalized in the background
+	size_t writeFrame( const unsigned char* data, size_t size );  // handles dead and stalled encoders, returns the bytes written
+	bool restartEncoder();  // replaces a dead or stalled ffmpeg process with one writing the next file
+	void addOutputFile( const std::string& path );  // updates the ffconcat manifest once there's more than one file
 
 	void processFrame();
+	void processAudio();
+	void processPrewarm();
+	void processReplay();
 };
 
-}  // namespace ofxFFmpeg
\ No newline at end of file
+}  // namespace ofxFFmpeg
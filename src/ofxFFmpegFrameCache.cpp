@@ -0,0 +1,168 @@
+#include "ofxFFmpegFrameCache.h"
+
+namespace ofxFFmpeg {
+
+namespace {
+
+	const size_t MaxSpares = 8;  // evicted pixels kept for acquire()
+}  // namespace
+
+// -----------------------------------------------------------------
+FrameCache::FrameCache( size_t budget )
+    : m_budget( budget )
+{
+}
+
+// -----------------------------------------------------------------
+void FrameCache::setBudget( size_t bytes )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_budget = bytes;
+	evict();
+}
+
+// -----------------------------------------------------------------
+size_t FrameCache::getBudget() const
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	return m_budget;
+}
+
+// -----------------------------------------------------------------
+bool FrameCache::findKey( const std::string &path, int frame, Key &key ) const
+{
+	const auto it = m_fileIds.find( path );
+	if ( it == m_fileIds.end() ) return false;
+	key = ( Key( it->second ) << 32 ) | uint32_t( frame );
+	return true;
+}
+
+// -----------------------------------------------------------------
+bool FrameCache::get( const std::string &path, int frame, ofPixels &pixels )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	Key key       = 0;
+	const auto it = findKey( path, frame, key ) ? m_lookup.find( key ) : m_lookup.end();
+	if ( it == m_lookup.end() ) {
+		++m_nMisses;
+		return false;
+	}
+
+	m_entries.splice( m_entries.begin(), m_entries, it->second );  // most recently used
+
+	// into the caller's pixels, so an eviction can't pull the frame from under it
+	const ofPixels &cached = it->second->pixels;
+	if ( pixels.getWidth() != cached.getWidth() || pixels.getHeight() != cached.getHeight() || pixels.getPixelFormat() != cached.getPixelFormat() ) {
+		pixels.allocate( cached.getWidth(), cached.getHeight(), cached.getPixelFormat() );
+	}
+	std::memcpy( pixels.getData(), cached.getData(), cached.getTotalBytes() );
+
+	++m_nHits;
+	return true;
+}
+
+// -----------------------------------------------------------------
+bool FrameCache::contains( const std::string &path, int frame ) const
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	Key key = 0;
+	return findKey( path, frame, key ) && m_lookup.count( key ) > 0;
+}
+
+// -----------------------------------------------------------------
+ofPixels FrameCache::acquire( size_t width, size_t height, ofPixelFormat format )
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		for ( auto it = m_spares.begin(); it != m_spares.end(); ++it ) {
+			if ( it->getWidth() == width && it->getHeight() == height && it->getPixelFormat() == format ) {
+				ofPixels pixels = std::move( *it );
+				m_spares.erase( it );
+				return pixels;
+			}
+		}
+	}
+
+	ofPixels pixels;
+	pixels.allocate( width, height, format );
+	return pixels;
+}
+
+// -----------------------------------------------------------------
+void FrameCache::put( const std::string &path, int frame, ofPixels &&pixels )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	auto id = m_fileIds.find( path );
+	if ( id == m_fileIds.end() ) id = m_fileIds.emplace( path, uint32_t( m_fileIds.size() ) ).first;
+	const Key key = ( Key( id->second ) << 32 ) | uint32_t( frame );
+
+	const auto it = m_lookup.find( key );
+	if ( it != m_lookup.end() ) {
+		// decoded again - keep the new pixels, recycle the old ones
+		m_entries.splice( m_entries.begin(), m_entries, it->second );
+		std::swap( it->second->pixels, pixels );
+		m_bytes += it->second->pixels.getTotalBytes();
+		m_bytes -= pixels.getTotalBytes();
+		if ( m_spares.size() < MaxSpares ) m_spares.push_back( std::move( pixels ) );
+	} else {
+		m_bytes += pixels.getTotalBytes();
+		m_entries.push_front( { key, std::move( pixels ) } );
+		m_lookup[key] = m_entries.begin();
+	}
+
+	++m_nInserts;
+	evict();
+}
+
+// -----------------------------------------------------------------
+void FrameCache::put( const std::string &path, int frame, const ofPixels &pixels )
+{
+	ofPixels copy = acquire( pixels.getWidth(), pixels.getHeight(), pixels.getPixelFormat() );
+	std::memcpy( copy.getData(), pixels.getData(), pixels.getTotalBytes() );
+	put( path, frame, std::move( copy ) );
+}
+
+// -----------------------------------------------------------------
+void FrameCache::evict()
+{
+	// the most recent frame stays, even if it's over budget on its own
+	while ( m_bytes > m_budget && m_entries.size() > 1 ) {
+		Entry &entry = m_entries.back();
+		m_bytes -= entry.pixels.getTotalBytes();
+		m_lookup.erase( entry.key );
+		if ( m_spares.size() < MaxSpares ) m_spares.push_back( std::move( entry.pixels ) );
+		m_entries.pop_back();
+		++m_nEvictions;
+	}
+}
+
+// -----------------------------------------------------------------
+void FrameCache::clear()
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_entries.clear();
+	m_lookup.clear();
+	m_spares.clear();
+	m_bytes = 0;
+}
+
+// -----------------------------------------------------------------
+FrameCacheStats FrameCache::getStats() const
+{
+	FrameCacheStats stats;
+	stats.hits      = m_nHits.load();
+	stats.misses    = m_nMisses.load();
+	stats.inserts   = m_nInserts.load();
+	stats.evictions = m_nEvictions.load();
+	stats.hitRate   = stats.hits + stats.misses > 0 ? float( stats.hits ) / ( stats.hits + stats.misses ) : 0.f;
+
+	std::lock_guard<std::mutex> lock( m_mutex );
+	stats.frames = m_entries.size();
+	stats.bytes  = m_bytes;
+	stats.budget = m_budget;
+	return stats;
+}
+
+}  // namespace ofxFFmpeg
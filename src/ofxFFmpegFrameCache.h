@@ -0,0 +1,64 @@
+#pragma once
+#include "ofxFFmpegHelpers.h"
+
+#include <unordered_map>
+
+namespace ofxFFmpeg {
+
+struct FrameCacheStats
+{
+	uint64_t hits      = 0;  // get() found the frame
+	uint64_t misses    = 0;
+	uint64_t inserts   = 0;
+	uint64_t evictions = 0;  // least recently used frames dropped to stay within the budget
+	size_t frames      = 0;
+	size_t bytes       = 0;
+	size_t budget      = 0;
+	float hitRate      = 0.f;  // hits / ( hits + misses )
+};
+
+/**
+ * FrameCache keeps decoded frames in memory up to a budget, keyed by file and frame number, evicting the least recently
+ * used ones. Evicted pixels are recycled by acquire(), so a full cache doesn't allocate for new frames of the same size.
+ * Thread safe - share one between players, decoders and prefetch workers.
+ */
+class FrameCache
+{
+public:
+	explicit FrameCache( size_t budget = size_t( 512 ) << 20 );
+
+	void setBudget( size_t bytes );  // evicts down to it right away
+	size_t getBudget() const;
+
+	// copies the frame into pixels if it's cached, and counts a hit or a miss
+	bool get( const std::string& path, int frame, ofPixels& pixels );
+	bool contains( const std::string& path, int frame ) const;  // neither counts nor changes the eviction order
+
+	ofPixels acquire( size_t width, size_t height, ofPixelFormat format );  // pixels for put(), recycled when possible
+	void put( const std::string& path, int frame, ofPixels&& pixels );
+	void put( const std::string& path, int frame, const ofPixels& pixels );  // copies into acquired pixels
+
+	void clear();
+	FrameCacheStats getStats() const;
+
+protected:
+	using Key = uint64_t;  // file id << 32 | frame
+	struct Entry
+	{
+		Key key = 0;
+		ofPixels pixels;
+	};
+
+	std::list<Entry> m_entries;  // most recently used first
+	std::unordered_map<Key, std::list<Entry>::iterator> m_lookup;
+	std::unordered_map<std::string, uint32_t> m_fileIds;
+	std::vector<ofPixels> m_spares;  // evicted, for acquire()
+	size_t m_budget = 0, m_bytes = 0;
+	mutable std::mutex m_mutex;
+	std::atomic<uint64_t> m_nHits { 0 }, m_nMisses { 0 }, m_nInserts { 0 }, m_nEvictions { 0 };
+
+	bool findKey( const std::string& path, int frame, Key& key ) const;
+	void evict();  // down to the budget, needs the lock
+};
+
+}  // namespace ofxFFmpeg
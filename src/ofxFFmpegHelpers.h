@@ -2,12 +2,22 @@
 // openFrameworks
 #include "ofTypes.h"
 //#include "ofBaseSoundStream.h"
+#include "ofImage.h"
 #include "ofJson.h"
 #include "ofPixels.h"
 #include "ofRectangle.h"
 #include "ofSoundBaseTypes.h"
 #include "ofVideoBaseTypes.h"
 
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+
 #if defined( TARGET_OSX )
 #include <thread>
 #endif
@@ -20,6 +30,7 @@ using Seconds   = std::chrono::duration<float>;
 
 /**
  * LockFreeQueue is taken from here: https://github.com/timscaffidi/ofxVideoRecorder/blob/master/src/ofxVideoRecorder.h#L9
+ * The size is counted in an atomic, walking the list from another thread would race with produce() and consume().
  */
 template <typename T>
 struct LockFreeQueue
@@ -38,6 +49,7 @@ struct LockFreeQueue
 		m_List.push_back( t );
 		m_TailIt = m_List.end();
 		m_List.erase( m_List.begin(), m_HeadIt );
+		++m_Size;
 	}
 
 	bool consume( T& t )
@@ -47,6 +59,7 @@ struct LockFreeQueue
 		if ( nextIt != m_TailIt ) {
 			m_HeadIt = nextIt;
 			t        = *m_HeadIt;
+			--m_Size;
 			return true;
 		}
 
@@ -55,7 +68,7 @@ struct LockFreeQueue
 
 	int size() const
 	{
-		return std::distance( m_HeadIt, m_TailIt ) - 1;
+		return m_Size.load();
 	}
 
 	typename std::list<T>::iterator getHead() const
@@ -72,5 +85,174 @@ private:
 	using TList = std::list<T>;
 	TList m_List;
 	typename TList::iterator m_HeadIt, m_TailIt;
+	std::atomic<int> m_Size { 0 };
+};
+
+/**
+ * RingBuffer is a wait-free single producer / single consumer ring of samples.
+ * All storage is allocated up front by allocate(), so write() and read() never allocate or lock
+ * and are safe to call from a realtime audio callback.
+ */
+template <typename T>
+class RingBuffer
+{
+public:
+	RingBuffer() {}
+	explicit RingBuffer( size_t capacity ) { allocate( capacity ); }
+
+	// not thread safe - call before the producer and consumer threads start
+	void allocate( size_t capacity )
+	{
+		size_t size = 1;
+		while ( size < capacity ) size <<= 1;  // round up to a power of two, so indices can be masked
+		m_buffer.assign( size, T() );
+		m_mask = size - 1;
+		m_readIdx.store( 0 );
+		m_writeIdx.store( 0 );
+	}
+
+	// producer: copies up to count items, returns the number of items written
+	size_t write( const T* data, size_t count )
+	{
+		const size_t writeIdx = m_writeIdx.load( std::memory_order_relaxed );
+		const size_t readIdx  = m_readIdx.load( std::memory_order_acquire );
+		const size_t n        = std::min( count, capacity() - ( writeIdx - readIdx ) );
+
+		for ( size_t i = 0; i < n; ++i ) {
+			m_buffer[( writeIdx + i ) & m_mask] = data[i];
+		}
+
+		m_writeIdx.store( writeIdx + n, std::memory_order_release );
+		return n;
+	}
+
+	// consumer: copies up to count items, returns the number of items read
+	size_t read( T* data, size_t count )
+	{
+		const size_t readIdx  = m_readIdx.load( std::memory_order_relaxed );
+		const size_t writeIdx = m_writeIdx.load( std::memory_order_acquire );
+		const size_t n        = std::min( count, writeIdx - readIdx );
+
+		for ( size_t i = 0; i < n; ++i ) {
+			data[i] = m_buffer[( readIdx + i ) & m_mask];
+		}
+
+		m_readIdx.store( readIdx + n, std::memory_order_release );
+		return n;
+	}
+
+	size_t size() const { return m_writeIdx.load( std::memory_order_acquire ) - m_readIdx.load( std::memory_order_acquire ); }
+	size_t capacity() const { return m_buffer.size(); }
+	size_t getFreeSpace() const { return capacity() - size(); }
+	bool isAllocated() const { return !m_buffer.empty(); }
+
+private:
+	std::vector<T> m_buffer;
+	size_t m_mask = 0;
+	alignas( 64 ) std::atomic<size_t> m_readIdx { 0 };   // separate cache lines, so producer and consumer don't false share
+	alignas( 64 ) std::atomic<size_t> m_writeIdx { 0 };
+};
+
+/**
+ * LatencyHistogram collects durations into logarithmic buckets (4 per octave, from 1 us to ~70 min).
+ * Everything is a relaxed atomic, so add() is cheap and percentiles can be read from any thread while it's being written.
+ */
+class LatencyHistogram
+{
+public:
+	void add( Seconds duration )
+	{
+		const uint64_t micros = uint64_t( std::max( 0.f, duration.count() ) * 1e6f );
+		const size_t bucket   = micros == 0 ? 0 : std::min( NumBuckets - 1, size_t( std::log2( double( micros ) ) * 4. ) + 1 );
+		m_buckets[bucket].fetch_add( 1, std::memory_order_relaxed );
+		m_count.fetch_add( 1, std::memory_order_relaxed );
+
+		uint64_t max = m_maxMicros.load( std::memory_order_relaxed );
+		while ( micros > max && !m_maxMicros.compare_exchange_weak( max, micros, std::memory_order_relaxed ) ) {}
+	}
+
+	// percentile in [0, 1], returns the upper bound of the bucket it falls in
+	Seconds getPercentile( float percentile ) const
+	{
+		const uint64_t count = m_count.load( std::memory_order_relaxed );
+		if ( count == 0 ) return Seconds( 0.f );
+
+		const uint64_t rank = std::max<uint64_t>( 1, uint64_t( std::ceil( percentile * count ) ) );
+		uint64_t seen       = 0;
+		for ( size_t i = 0; i < NumBuckets; ++i ) {
+			seen += m_buckets[i].load( std::memory_order_relaxed );
+			if ( seen >= rank ) return std::min( getBucketLimit( i ), getMax() );
+		}
+		return getMax();
+	}
+
+	Seconds getMax() const { return Seconds( m_maxMicros.load( std::memory_order_relaxed ) * 1e-6f ); }
+	uint64_t getCount() const { return m_count.load( std::memory_order_relaxed ); }
+
+	void reset()
+	{
+		for ( auto& bucket : m_buckets ) bucket.store( 0, std::memory_order_relaxed );
+		m_count.store( 0, std::memory_order_relaxed );
+		m_maxMicros.store( 0, std::memory_order_relaxed );
+	}
+
+private:
+	static const size_t NumBuckets = 128;
+
+	static Seconds getBucketLimit( size_t bucket ) { return Seconds( float( std::exp2( bucket / 4. ) * 1e-6 ) ); }
+
+	std::array<std::atomic<uint64_t>, NumBuckets> m_buckets {};
+	std::atomic<uint64_t> m_count { 0 }, m_maxMicros { 0 };
+};
+
+/**
+ * LinearResampler stretches a stream of interleaved samples by a slowly varying ratio, using linear interpolation.
+ * State is kept between blocks, so consecutive calls to process() produce a continuous signal.
+ */
+class LinearResampler
+{
+public:
+	void setup( size_t nChannels )
+	{
+		m_nChannels = nChannels;
+		m_lastFrame.assign( nChannels, 0.f );
+		m_position = 1.;  // the first output sample lands on the first input sample
+	}
+
+	// ratio is output / input length, so ratio > 1 stretches and ratio < 1 squeezes the audio
+	// out must have room for at least nInFrames * ratio + 1 sample frames, returns the number of sample frames written
+	size_t process( const float* in, size_t nInFrames, float* out, double ratio )
+	{
+		if ( nInFrames == 0 || m_nChannels == 0 ) return 0;
+
+		// position is relative to the previous block's last frame (0), so in[0] sits at position 1
+		const double step = 1. / ratio;
+		size_t nOutFrames = 0;
+
+		while ( m_position < nInFrames ) {
+			const size_t idx   = size_t( m_position );
+			const float frac   = float( m_position - idx );
+			const float* prev  = idx == 0 ? m_lastFrame.data() : in + ( idx - 1 ) * m_nChannels;
+			const float* next  = in + idx * m_nChannels;
+			float* dst         = out + nOutFrames * m_nChannels;
+
+			for ( size_t c = 0; c < m_nChannels; ++c ) {
+				dst[c] = prev[c] + ( next[c] - prev[c] ) * frac;
+			}
+
+			++nOutFrames;
+			m_position += step;
+		}
+
+		m_position -= nInFrames;
+		std::copy( in + ( nInFrames - 1 ) * m_nChannels, in + nInFrames * m_nChannels, m_lastFrame.begin() );
+
+		return nOutFrames;
+	}
+
+private:
+	size_t m_nChannels = 0;
+	std::vector<float> m_lastFrame;
+	double m_position = 1.;
 };
 }  // namespace ofxFFmpeg
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include "ofxFFmpegKeyframeIndex.h"
+#include "ofxFFmpegProbe.h"
+#include "ofxFFmpegProcess.h"
+// openFrameworks
+#include "ofLog.h"
+
+namespace ofxFFmpeg {
+
+namespace {
+
+	double parseTime( const ofJson &json, const std::string &key )
+	{
+		const std::string value = json.contains( key ) && json[key].is_string() ? json[key].get<std::string>() : "";
+		return value.empty() || value == "N/A" ? NAN : std::strtod( value.c_str(), nullptr );
+	}
+}  // namespace
+
+// -----------------------------------------------------------------
+bool KeyframeIndex::setup( const std::string &mediaPath, const std::string &ffprobePath, bool useCache )
+{
+	const std::string cachePath = getCachePath( mediaPath );
+	if ( useCache && ofFile::doesFileExist( cachePath, false ) && load( cachePath, mediaPath ) ) {
+		return true;
+	}
+
+	if ( !build( mediaPath, ffprobePath ) ) return false;
+
+	if ( useCache && !save( cachePath ) ) {
+		ofLogVerbose( "ofxFFmpeg" ) << __FUNCTION__ << ": Unable to cache keyframe index at " << cachePath;
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------
+bool KeyframeIndex::build( const std::string &mediaPath, const std::string &ffprobePath, std::atomic<int> *pid )
+{
+	clear();
+
+	const std::string cmd = ( ffprobePath.empty() ? "ffprobe" : ffprobePath ) +
+	                        " -v error"
+	                        " -select_streams v:0"
+	                        " -show_packets"
+	                        " -show_entries packet=pts_time,flags:format=start_time"
+	                        " -of json"
+	                        " " + quoteArg( mediaPath );
+
+	const std::string output = getProcessOutput( cmd, pid );
+	if ( output.empty() ) {
+		ofLogError( "ofxFFmpeg" ) << __FUNCTION__ << ": Unable to list the packets of " << mediaPath;
+		return false;
+	}
+
+	// packets come in decode order, frame numbers are their rank in presentation order
+	std::vector<double> times, keyTimes;
+	try {
+		const ofJson json = ofJson::parse( output );
+		if ( json.contains( "packets" ) ) {
+			times.reserve( json["packets"].size() );
+			for ( const auto &packet : json["packets"] ) {
+				const double time = parseTime( packet, "pts_time" );
+				if ( std::isnan( time ) ) continue;
+
+				times.push_back( time );
+				if ( packet.value( "flags", "" ).find( 'K' ) != std::string::npos ) keyTimes.push_back( time );
+			}
+		}
+		if ( json.contains( "format" ) ) {
+			const double startTime = parseTime( json["format"], "start_time" );
+			m_startTime            = std::isnan( startTime ) ? 0. : startTime;
+		}
+	} catch ( const std::exception &e ) {
+		ofLogError( "ofxFFmpeg" ) << __FUNCTION__ << ": Unable to parse the packets of " << mediaPath << ": " << e.what();
+		return false;
+	}
+
+	if ( keyTimes.empty() ) {
+		ofLogError( "ofxFFmpeg" ) << __FUNCTION__ << ": No keyframes in " << mediaPath;
+		return false;
+	}
+
+	std::sort( times.begin(), times.end() );
+	std::sort( keyTimes.begin(), keyTimes.end() );
+
+	for ( const double time : keyTimes ) {
+		const int frame = int( std::lower_bound( times.begin(), times.end(), time ) - times.begin() );
+		m_keyframes.push_back( { frame, time } );
+	}
+
+	m_nFrames   = int( times.size() );
+	m_frameTime = m_nFrames > 1 ? ( times.back() - times.front() ) / ( m_nFrames - 1 ) : 0.;
+	getFileStamp( mediaPath, m_mediaSize, m_mediaTime );
+
+	return true;
+}
+
+// -----------------------------------------------------------------
+bool KeyframeIndex::load( const std::string &indexPath, const std::string &mediaPath )
+{
+	clear();
+
+	uint64_t size = 0;
+	int64_t time  = 0;
+	if ( !getFileStamp( mediaPath, size, time ) ) return false;
+
+	try {
+		const ofJson json = ofLoadJson( indexPath );
+		if ( json.value( "version", 0 ) != CacheVersion || json.value( "size", uint64_t( 0 ) ) != size || json.value( "mtime", int64_t( 0 ) ) != time ) {
+			return false;  // stale
+		}
+
+		m_nFrames   = json.value( "frames", 0 );
+		m_startTime = json.value( "startTime", 0. );
+		m_frameTime = json.value( "frameTime", 0. );
+		for ( const auto &keyframe : json["keyframes"] ) {
+			m_keyframes.push_back( { keyframe[0].get<int>(), keyframe[1].get<double>() } );
+		}
+	} catch ( const std::exception &e ) {
+		ofLogWarning( "ofxFFmpeg" ) << __FUNCTION__ << ": Unable to read " << indexPath << ": " << e.what();
+		clear();
+		return false;
+	}
+
+	m_mediaSize = size;
+	m_mediaTime = time;
+	return !m_keyframes.empty();
+}
+
+// -----------------------------------------------------------------
+bool KeyframeIndex::save( const std::string &indexPath ) const
+{
+	if ( isEmpty() ) return false;
+
+	ofJson keyframes = ofJson::array();
+	for ( const auto &keyframe : m_keyframes ) {
+		keyframes.push_back( { keyframe.frame, keyframe.time } );
+	}
+
+	const ofJson json = {
+	    { "version", CacheVersion },
+	    { "size", m_mediaSize },
+	    { "mtime", m_mediaTime },
+	    { "frames", m_nFrames },
+	    { "startTime", m_startTime },
+	    { "frameTime", m_frameTime },
+	    { "keyframes", keyframes },
+	};
+	return ofSaveJson( indexPath, json );
+}
+
+// -----------------------------------------------------------------
+void KeyframeIndex::clear()
+{
+	m_keyframes.clear();
+	m_nFrames   = 0;
+	m_startTime = 0.;
+	m_frameTime = 0.;
+	m_mediaSize = 0;
+	m_mediaTime = 0;
+}
+
+// -----------------------------------------------------------------
+std::string KeyframeIndex::getCachePath( const std::string &mediaPath )
+{
+	return mediaPath + ".keyframes.json";
+}
+
+// -----------------------------------------------------------------
+std::vector<KeyframeIndex::Keyframe>::const_iterator KeyframeIndex::findKeyframeAfter( int frame ) const
+{
+	return std::upper_bound( m_keyframes.begin(), m_keyframes.end(), frame, []( int f, const Keyframe &keyframe ) { return f < keyframe.frame; } );
+}
+
+// -----------------------------------------------------------------
+int KeyframeIndex::getKeyframeBefore( int frame ) const
+{
+	const auto it = findKeyframeAfter( frame );
+	return it == m_keyframes.begin() ? 0 : std::prev( it )->frame;
+}
+
+// -----------------------------------------------------------------
+int KeyframeIndex::getKeyframeAfter( int frame ) const
+{
+	const auto it = findKeyframeAfter( frame );
+	return it == m_keyframes.end() ? m_nFrames : it->frame;
+}
+
+// -----------------------------------------------------------------
+bool KeyframeIndex::isKeyframe( int frame ) const
+{
+	const auto it = findKeyframeAfter( frame );
+	return it != m_keyframes.begin() && std::prev( it )->frame == frame;
+}
+
+// -----------------------------------------------------------------
+double KeyframeIndex::getSeekTime( int frame ) const
+{
+	const auto it = findKeyframeAfter( frame );
+	if ( it == m_keyframes.begin() ) return 0.;
+
+	// frames after the keyframe are timed by the average frame duration, which is exact for constant frame rates. ffmpeg
+	// seeks to the last keyframe at or before the time, and drops frames before it unless -noaccurate_seek is set - a
+	// keyframe is sought half a frame late and any other frame a quarter frame early, so rounding can't miss either
+	const Keyframe &keyframe = *std::prev( it );
+	const double time        = keyframe.time - m_startTime + ( frame - keyframe.frame ) * m_frameTime;
+	return std::max( 0., frame == keyframe.frame ? time + m_frameTime * 0.5 : time - m_frameTime * 0.25 );
+}
+
+}  // namespace ofxFFmpeg
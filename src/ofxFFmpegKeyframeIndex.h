@@ -0,0 +1,52 @@
+#pragma once
+#include "ofxFFmpegHelpers.h"
+
+namespace ofxFFmpeg {
+
+/**
+ * KeyframeIndex lists the keyframes of a file's first video stream by frame number, so decoding can start exactly on the
+ * keyframe before a frame instead of wherever a time based seek lands. It's built from ffprobe's packet list - headers
+ * only, nothing is decoded - and cached as JSON next to the media, along with the media's size and modification time.
+ */
+class KeyframeIndex
+{
+public:
+	// loads the cached index, or builds it and caches it - the cache is skipped if it can't be written
+	bool setup( const std::string& mediaPath, const std::string& ffprobePath = "ffprobe", bool useCache = true );
+	// reads every packet header with ffprobe - the pid is stored in pid while it runs, so another thread can kill it to cancel
+	bool build( const std::string& mediaPath, const std::string& ffprobePath = "ffprobe", std::atomic<int>* pid = nullptr );
+	bool load( const std::string& indexPath, const std::string& mediaPath );  // fails if the media has changed since it was saved
+	bool save( const std::string& indexPath ) const;
+	void clear();
+
+	static std::string getCachePath( const std::string& mediaPath );  // movie.mp4.keyframes.json
+
+	bool isEmpty() const { return m_keyframes.empty(); }
+	int getNumFrames() const { return m_nFrames; }
+	size_t getNumKeyframes() const { return m_keyframes.size(); }
+
+	bool isKeyframe( int frame ) const;
+	int getKeyframeBefore( int frame ) const;  // the last keyframe at or before frame
+	int getKeyframeAfter( int frame ) const;   // the first keyframe after frame, getNumFrames() if there's none
+
+	// an input -ss for frame - ffmpeg's first frame will be frame. Use it with -noaccurate_seek for keyframes, so ffmpeg
+	// starts right on them, and without for other frames, so ffmpeg decodes from the keyframe before and drops the rest
+	double getSeekTime( int frame ) const;
+
+protected:
+	struct Keyframe
+	{
+		int frame   = 0;   // in presentation order
+		double time = 0.;  // pts in seconds
+	};
+	std::vector<Keyframe> m_keyframes;
+	int m_nFrames        = 0;
+	double m_startTime   = 0.;  // the file's start time, -ss is relative to it
+	double m_frameTime   = 0.;  // average frame duration
+	uint64_t m_mediaSize = 0;   // of the file the index was built for
+	int64_t m_mediaTime  = 0;
+
+	std::vector<Keyframe>::const_iterator findKeyframeAfter( int frame ) const;
+};
+
+}  // namespace ofxFFmpeg
@@ -0,0 +1,201 @@
+#include "ofxFFmpegPacketRing.h"
+
+#include <fstream>
+
+namespace ofxFFmpeg {
+
+namespace {
+
+	const uint64_t PtsClock = 90000;
+
+	// PTS are 33 bit and wrap around after ~26 hours
+	uint64_t getPtsDelta( uint64_t from, uint64_t to )
+	{
+		return ( to - from ) & ( ( uint64_t( 1 ) << 33 ) - 1 );
+	}
+}  // namespace
+
+// -----------------------------------------------------------------
+void PacketRing::setup( float duration )
+{
+	clear();
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_maxDuration = uint64_t( std::max( 0.f, duration ) * PtsClock );
+}
+
+// -----------------------------------------------------------------
+void PacketRing::clear()
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_gops.clear();
+	m_nBytes  = 0;
+	m_lastPts = 0;
+	m_pat.clear();
+	m_pmt.clear();
+	m_partial.clear();
+	m_pmtPid   = -1;
+	m_videoPid = -1;
+	publish();
+}
+
+// -----------------------------------------------------------------
+void PacketRing::push( const char *data, size_t size )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	// complete the packet left over from the previous call
+	if ( !m_partial.empty() ) {
+		const size_t n = std::min( PacketSize - m_partial.size(), size );
+		m_partial.insert( m_partial.end(), data, data + n );
+		data += n;
+		size -= n;
+
+		if ( m_partial.size() < PacketSize ) return;  // nothing new to publish
+		pushPacket( reinterpret_cast<const unsigned char *>( m_partial.data() ) );
+		m_partial.clear();
+	}
+
+	while ( size >= PacketSize ) {
+		if ( data[0] != 0x47 ) {
+			// lost sync, skip to the next sync byte
+			++data;
+			--size;
+			continue;
+		}
+		pushPacket( reinterpret_cast<const unsigned char *>( data ) );
+		data += PacketSize;
+		size -= PacketSize;
+	}
+
+	m_partial.assign( data, data + size );
+	publish();
+}
+
+// -----------------------------------------------------------------
+void PacketRing::pushPacket( const unsigned char *packet )
+{
+	if ( packet[0] != 0x47 ) return;
+
+	const int pid          = ( ( packet[1] & 0x1f ) << 8 ) | packet[2];
+	const bool isUnitStart = packet[1] & 0x40;
+	const int adaptation   = ( packet[3] >> 4 ) & 0x3;
+
+	size_t offset       = 4;
+	bool isRandomAccess = false;
+	if ( adaptation & 0x2 ) {
+		isRandomAccess = packet[4] > 0 && ( packet[5] & 0x40 );
+		offset += 1 + packet[4];
+	}
+
+	const bool hasPayload        = ( adaptation & 0x1 ) && offset < PacketSize;
+	const unsigned char *payload = packet + offset;
+	const size_t payloadSize     = hasPayload ? PacketSize - offset : 0;
+
+	if ( pid == 0 && isUnitStart && payloadSize > 0 ) {
+		// PAT - the first program's PMT pid follows the 8 byte section header
+		m_pat.assign( packet, packet + PacketSize );
+		const size_t section = 1 + payload[0];  // skip the pointer field
+		if ( section + 12 <= payloadSize ) {
+			m_pmtPid = ( ( payload[section + 10] & 0x1f ) << 8 ) | payload[section + 11];
+		}
+	} else if ( pid == m_pmtPid && isUnitStart ) {
+		m_pmt.assign( packet, packet + PacketSize );
+	} else if ( isUnitStart && payloadSize >= 14 && payload[0] == 0 && payload[1] == 0 && payload[2] == 1 && ( payload[3] & 0xf0 ) == 0xe0 ) {
+		// start of a video PES
+		if ( m_videoPid < 0 ) m_videoPid = pid;
+
+		if ( pid == m_videoPid && ( payload[7] & 0x80 ) ) {
+			m_lastPts = ( uint64_t( payload[9] & 0x0e ) << 29 ) | ( uint64_t( payload[10] ) << 22 ) | ( uint64_t( payload[11] & 0xfe ) << 14 ) | ( uint64_t( payload[12] ) << 7 ) | ( payload[13] >> 1 );
+
+			if ( isRandomAccess ) {
+				m_gops.push_back( { m_lastPts, std::make_shared<std::vector<char>>() } );
+
+				// drop the oldest GOP once the ones after it cover the duration on their own
+				while ( m_gops.size() > 1 && getPtsDelta( m_gops[1].pts, m_lastPts ) >= m_maxDuration ) {
+					m_nBytes -= m_gops.front().data->size();
+					m_gops.pop_front();
+				}
+			}
+		}
+	}
+
+	// anything before the first keyframe can't be decoded
+	if ( m_gops.empty() ) return;
+
+	std::vector<char> &gop = *m_gops.back().data;
+	gop.insert( gop.end(), packet, packet + PacketSize );
+	m_nBytes += PacketSize;
+}
+
+// -----------------------------------------------------------------
+std::vector<PacketRing::Chunk> PacketRing::getChunks( float duration ) const
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	std::vector<Chunk> chunks;
+	if ( m_gops.empty() || m_pat.empty() || m_pmt.empty() ) {
+		return chunks;
+	}
+
+	// the latest GOP that still covers the duration
+	size_t first = 0;
+	if ( duration >= 0.f ) {
+		const uint64_t window = uint64_t( duration * PtsClock );
+		for ( size_t i = m_gops.size(); i-- > 0; ) {
+			if ( getPtsDelta( m_gops[i].pts, m_lastPts ) >= window ) {
+				first = i;
+				break;
+			}
+		}
+	}
+
+	std::vector<char> tables( m_pat );
+	tables.insert( tables.end(), m_pmt.begin(), m_pmt.end() );
+	chunks.push_back( std::make_shared<const std::vector<char>>( std::move( tables ) ) );
+
+	for ( size_t i = first; i + 1 < m_gops.size(); ++i ) {
+		chunks.push_back( m_gops[i].data );
+	}
+	chunks.push_back( std::make_shared<const std::vector<char>>( *m_gops.back().data ) );  // still growing
+
+	return chunks;
+}
+
+// -----------------------------------------------------------------
+bool PacketRing::save( const std::vector<Chunk> &chunks, const std::string &path )
+{
+	std::ofstream file( path, std::ios::binary | std::ios::trunc );
+	for ( const auto &chunk : chunks ) {
+		file.write( chunk->data(), chunk->size() );
+	}
+	return !chunks.empty() && file.good();
+}
+
+// -----------------------------------------------------------------
+void PacketRing::publish()
+{
+	const float duration = m_gops.empty() ? 0.f : getPtsDelta( m_gops.front().pts, m_lastPts ) / float( PtsClock );
+	m_publishedDuration.store( duration, std::memory_order_relaxed );
+	m_publishedBytes.store( m_nBytes, std::memory_order_relaxed );
+}
+
+// -----------------------------------------------------------------
+float PacketRing::getDuration() const
+{
+	return m_publishedDuration.load( std::memory_order_relaxed );
+}
+
+// -----------------------------------------------------------------
+size_t PacketRing::getNumBytes() const
+{
+	return m_publishedBytes.load( std::memory_order_relaxed );
+}
+
+// -----------------------------------------------------------------
+size_t PacketRing::getNumGops() const
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	return m_gops.size();
+}
+
+}  // namespace ofxFFmpeg
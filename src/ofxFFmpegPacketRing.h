@@ -0,0 +1,58 @@
+#pragma once
+#include "ofxFFmpegHelpers.h"
+
+namespace ofxFFmpeg {
+
+/**
+ * PacketRing keeps the most recent seconds of an MPEG transport stream as whole GOPs, so they can be written to a file
+ * without re-encoding. Packets are grouped from one video keyframe (flagged with the random access indicator) to the next,
+ * timed by the video PTS, and the latest PAT and PMT are kept so a file can start at any GOP.
+ * push() is called by a single reader thread, the getters are safe to call from any thread meanwhile - getDuration() and
+ * getNumBytes() read atomics published by push(), so polling them never contends with it.
+ */
+class PacketRing
+{
+public:
+	static constexpr size_t PacketSize = 188;
+
+	using Chunk = std::shared_ptr<const std::vector<char>>;
+
+	void setup( float duration );  // seconds to keep - whole GOPs are kept, so up to one GOP more
+	void clear();                  // call setup() and clear() while nothing is pushing
+
+	void push( const char* data, size_t size );  // any amount of stream, it doesn't need to be packet aligned
+
+	// the last duration seconds (everything if < 0), starting with a PAT, a PMT and a keyframe
+	// cheap - completed GOPs are shared, only the one being received is copied
+	std::vector<Chunk> getChunks( float duration = -1.f ) const;
+	static bool save( const std::vector<Chunk>& chunks, const std::string& path );
+
+	float getDuration() const;  // seconds held
+	size_t getNumBytes() const;
+	size_t getNumGops() const;
+
+protected:
+	struct Gop
+	{
+		uint64_t pts = 0;  // of the keyframe, 90 kHz
+		std::shared_ptr<std::vector<char>> data;
+	};
+
+	mutable std::mutex m_mutex;
+	uint64_t m_maxDuration = 0;  // 90 kHz
+	std::deque<Gop> m_gops;      // the last one is still being received
+	size_t m_nBytes    = 0;
+	uint64_t m_lastPts = 0;
+	std::atomic<size_t> m_publishedBytes { 0 };  // m_nBytes and the duration, as of the last push()
+	std::atomic<float> m_publishedDuration { 0.f };
+	std::vector<char> m_pat, m_pmt;
+
+	// parser state, only touched by push()
+	std::vector<char> m_partial;  // the start of a packet split across push() calls
+	int m_pmtPid = -1, m_videoPid = -1;
+
+	void pushPacket( const unsigned char* packet );
+	void publish();  // with m_mutex held
+};
+
+}  // namespace ofxFFmpeg
@@ -0,0 +1,879 @@
+#include "ofxFFmpegPlayer.h"
+#include "ofxFFmpegProcess.h"
+// openFrameworks
+#include "ofLog.h"
+#include "ofUtils.h"
+
+// Logging macros
+#define LOG_ERROR() ofLogError( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+#define LOG_WARNING() ofLogWarning( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+#define LOG_VERBOSE() ofLogVerbose( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+
+namespace ofxFFmpeg {
+
+// -----------------------------------------------------------------
+Player::Player()
+{
+}
+
+// -----------------------------------------------------------------
+Player::~Player()
+{
+	close();
+}
+
+// -----------------------------------------------------------------
+void Player::setup( const PlayerSettings &settings )
+{
+	if ( m_isLoaded ) {
+		LOG_WARNING() << "Settings take effect with the next load()";
+	}
+	m_settings = settings;
+}
+
+// -----------------------------------------------------------------
+size_t Player::getNumBufferedFrames() const
+{
+	std::lock_guard<std::mutex> lock( m_ringMutex );
+	return m_ringSize;
+}
+
+// -----------------------------------------------------------------
+PlayerStats Player::getStats() const
+{
+	const ReverseDecoderStats reverse = m_isReversing ? m_reverseDecoder.getStats() : ReverseDecoderStats();
+
+	PlayerStats stats;
+	stats.framesDecoded    = m_nDecodedFrames.load() + reverse.framesDecoded;
+	stats.framesDiscarded  = m_nDiscardedFrames.load();
+	stats.framesSkipped    = m_nSkippedFrames.load();
+	stats.decoderSpawns    = m_nDecoderSpawns.load();
+	stats.seeks            = m_nSeeks.load();
+	stats.bufferedSeeks    = m_nBufferedSeeks.load();
+	stats.forwardSeeks     = m_nForwardSeeks.load();
+	stats.cachedSeeks      = m_nCachedSeeks.load();
+	stats.framesPrefetched = m_nPrefetchedFrames.load();
+	stats.reverseChunks    = m_nReverseChunks.load() + reverse.chunksDecoded;
+	stats.seekLatencyP50   = m_seekLatency.getPercentile( 0.5f ).count();
+	stats.seekLatencyP90   = m_seekLatency.getPercentile( 0.9f ).count();
+	stats.seekLatencyP99   = m_seekLatency.getPercentile( 0.99f ).count();
+	stats.seekLatencyMax   = m_seekLatency.getMax().count();
+	stats.hasKeyframeIndex = hasKeyframeIndex();
+	return stats;
+}
+
+// -----------------------------------------------------------------
+std::shared_ptr<const KeyframeIndex> Player::getKeyframeIndex() const
+{
+	std::lock_guard<std::mutex> lock( m_indexMutex );
+	return m_index;
+}
+
+// -----------------------------------------------------------------
+int Player::getTotalNumFrames() const
+{
+	// the index counts packets, the probe may have estimated from the duration
+	const auto index = getKeyframeIndex();
+	return index ? index->getNumFrames() : m_info.numFrames;
+}
+
+// -----------------------------------------------------------------
+bool Player::load( std::string path )
+{
+	close();
+
+	m_info = m_settings.probeCache ? m_settings.probeCache->probe( path ) : probeMedia( ofToDataPath( path ), m_settings.ffprobePath );
+	if ( !m_info.isValid() ) {
+		LOG_ERROR() << "Unable to load " << path;
+		return false;
+	}
+
+	// everything the decoder and update() need from here on
+	m_pixels.allocate( m_info.width, m_info.height, m_settings.pixelFormat );
+	m_pixels.set( 0 );
+	m_ring.resize( std::max<size_t>( 1, m_settings.decodeAhead ) );
+	for ( auto &frame : m_ring ) {
+		frame.pixels.allocate( m_info.width, m_info.height, m_settings.pixelFormat );
+	}
+
+	// a cached index is cheap to read, otherwise it's built while the first frames play
+	if ( m_settings.useKeyframeIndex ) {
+		auto index = std::make_shared<KeyframeIndex>();
+		if ( m_settings.cacheKeyframeIndex && index->load( KeyframeIndex::getCachePath( m_info.path ), m_info.path ) ) {
+			m_index = index;
+		} else {
+			m_indexThread = std::thread( &Player::processIndex, this, m_info.path );
+		}
+	}
+
+	m_nDecodedFrames    = 0;
+	m_nDiscardedFrames  = 0;
+	m_nSkippedFrames    = 0;
+	m_nDecoderSpawns    = 0;
+	m_nSeeks            = 0;
+	m_nBufferedSeeks    = 0;
+	m_nForwardSeeks     = 0;
+	m_nCachedSeeks      = 0;
+	m_nPrefetchedFrames = 0;
+	m_nReverseChunks    = 0;
+	m_seekLatency.reset();
+
+	// frames decoded with other settings can't be shared
+	m_cacheKey = m_info.path + "|" + std::to_string( m_settings.pixelFormat ) + "|" + m_settings.extraOutputArgs;
+
+	m_isLoaded         = true;
+	m_currentFrame     = 0;
+	m_dueFrames        = 0.;
+	m_stepFrames       = 1;
+	m_isCachedFrameNew = false;
+	m_isDecoderStale   = false;
+	if ( m_speed < 0.f ) {
+		startReverse();
+	} else {
+		startDecoder( 0 );
+	}
+	startPrefetch();
+
+	LOG_VERBOSE() << "Loaded " << m_info.path << " - " << m_info.width << "x" << m_info.height << " " << m_info.codec << " @ " << m_info.fps << " fps";
+	return true;
+}
+
+// -----------------------------------------------------------------
+void Player::close()
+{
+	stopPrefetch();
+	stopDecoder();
+	m_reverseDecoder.stop();
+	m_isReversing = false;
+
+	if ( m_indexThread.joinable() ) {
+		killProcess( m_indexPid.load() );
+		m_indexThread.join();
+	}
+	{
+		std::lock_guard<std::mutex> lock( m_indexMutex );
+		m_index.reset();
+	}
+
+	m_ring.clear();
+	m_pixels.clear();
+	m_info         = MediaInfo();
+	m_isLoaded     = false;
+	m_isPlaying    = false;
+	m_isPaused     = false;
+	m_isFrameNew   = false;
+	m_isMovieDone  = false;
+	m_currentFrame = 0;
+}
+
+// -----------------------------------------------------------------
+void Player::update()
+{
+	m_isFrameNew       = m_isCachedFrameNew;
+	m_isCachedFrameNew = false;
+	if ( !m_isLoaded ) return;
+
+	const TimePoint now = Clock::now();
+	if ( m_isPlaying && !m_isPaused && !m_isMovieDone ) {
+		// if the decoder falls behind, catch up by skipping at most a ring's worth of frames
+		m_dueFrames = std::min( m_dueFrames + Seconds( now - m_lastUpdateTime ).count() * m_info.fps * std::abs( m_speed ), double( m_ring.size() ) );
+	}
+	m_lastUpdateTime = now;
+
+	if ( m_isReversing ) {
+		updateReverse();
+		return;
+	}
+
+	const size_t nDue = size_t( m_dueFrames ) + m_stepFrames;
+	if ( nDue == 0 ) return;
+
+	// the displayed frame came from the cache, the decoder continues after it
+	if ( m_isDecoderStale ) {
+		m_isDecoderStale = false;
+		const int frame  = m_currentFrame + 1;
+		if ( frame >= getTotalNumFrames() && m_loopState.load() == OF_LOOP_PALINDROME && m_speed > 0.f ) {
+			m_speed = -m_speed;
+			startReverse();
+			return;
+		}
+		if ( frame >= getTotalNumFrames() && m_loopState.load() == OF_LOOP_NONE ) {
+			m_isMovieDone = true;
+			m_dueFrames   = 0.;
+			m_stepFrames  = 0;
+			return;
+		}
+		if ( !seekDecoder( frame ) ) {
+			stopDecoder();
+			startDecoder( frame < getTotalNumFrames() ? frame : 0 );
+		}
+	}
+
+	std::unique_lock<std::mutex> lock( m_ringMutex );
+
+	if ( m_ringSize == 0 ) {
+		if ( !m_isDecoderDone ) return;
+		lock.unlock();
+
+		// the decoder only loops with OF_LOOP_NORMAL
+		if ( m_loopState.load() == OF_LOOP_PALINDROME && m_speed > 0.f ) {
+			m_speed = -m_speed;
+			startReverse();
+			return;
+		}
+		m_isMovieDone = true;
+		m_dueFrames   = 0.;
+		m_stepFrames  = 0;
+		return;
+	}
+
+	// late frames are skipped, the latest due one is swapped with the displayed one
+	const size_t n      = std::min( nDue, m_ringSize );
+	DecodedFrame &frame = m_ring[( m_ringHead + n - 1 ) % m_ring.size()];
+	m_pixels.swap( frame.pixels );
+	m_currentFrame = frame.index;
+	m_isFrameNew   = true;
+	m_nSkippedFrames += n - 1;
+
+	if ( m_isSeeking && frame.index >= m_seekFrame ) {
+		m_seekLatency.add( now - m_seekTime );
+		m_isSeeking = false;
+	}
+
+	m_ringHead = ( m_ringHead + n ) % m_ring.size();
+	m_ringSize -= n;
+	m_ringCondition.notify_all();
+
+	const size_t nSteps = std::min( n, m_stepFrames );
+	m_stepFrames -= nSteps;
+	m_dueFrames -= double( n - nSteps );
+
+	setPrefetchCenter( m_currentFrame );
+}
+
+// -----------------------------------------------------------------
+void Player::play()
+{
+	if ( !m_isLoaded ) return;
+	if ( m_isMovieDone ) setFrame( m_speed < 0.f ? getTotalNumFrames() - 1 : 0 );
+
+	m_isPlaying      = true;
+	m_isPaused       = false;
+	m_lastUpdateTime = Clock::now();
+}
+
+// -----------------------------------------------------------------
+void Player::stop()
+{
+	if ( !m_isLoaded ) return;
+
+	m_isPlaying = false;
+	m_isPaused  = false;
+	setFrame( 0 );
+}
+
+// -----------------------------------------------------------------
+void Player::setPaused( bool isPaused )
+{
+	if ( m_isPaused && !isPaused ) {
+		m_lastUpdateTime = Clock::now();  // the time spent paused doesn't count
+	}
+	m_isPaused = isPaused;
+}
+
+// -----------------------------------------------------------------
+bool Player::setPixelFormat( ofPixelFormat pixelFormat )
+{
+	if ( pixelFormat != OF_PIXELS_RGB && pixelFormat != OF_PIXELS_RGBA ) {
+		LOG_ERROR() << "Only OF_PIXELS_RGB and OF_PIXELS_RGBA are supported";
+		return false;
+	}
+	if ( pixelFormat == m_settings.pixelFormat ) return true;
+
+	m_settings.pixelFormat = pixelFormat;
+
+	// the ring is allocated for the previous format
+	if ( m_isLoaded ) {
+		const int frame       = m_currentFrame;
+		const bool wasPlaying = m_isPlaying, wasPaused = m_isPaused;
+		load( m_info.path );
+		setFrame( frame );
+		if ( wasPlaying ) play();
+		setPaused( wasPaused );
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------
+float Player::getPosition() const
+{
+	const int nFrames = getTotalNumFrames();
+	return nFrames > 0 ? float( m_currentFrame ) / nFrames : 0.f;
+}
+
+// -----------------------------------------------------------------
+void Player::setPosition( float position )
+{
+	setFrame( int( ofClamp( position, 0.f, 1.f ) * getTotalNumFrames() ) );
+}
+
+// -----------------------------------------------------------------
+void Player::setFrame( int frame )
+{
+	if ( !m_isLoaded ) return;
+	const int nFrames = getTotalNumFrames();
+	if ( nFrames > 0 ) frame = std::min( frame, nFrames - 1 );
+	frame = std::max( frame, 0 );
+
+	++m_nSeeks;
+	m_isSeeking = true;
+	m_seekFrame = frame;
+	m_seekTime  = Clock::now();
+
+	m_currentFrame = frame;
+	m_isMovieDone  = false;
+	m_dueFrames    = 0.;
+	setPrefetchCenter( frame );
+
+	// scrubbing over cached frames doesn't touch ffmpeg until frames after them are due
+	if ( m_settings.frameCache && m_settings.frameCache->get( m_cacheKey, frame, m_pixels ) ) {
+		m_seekLatency.add( Clock::now() - m_seekTime );
+		m_isSeeking        = false;
+		m_isCachedFrameNew = true;
+		m_isDecoderStale   = true;
+		m_stepFrames       = 0;
+		++m_nCachedSeeks;
+		return;
+	}
+
+	m_isDecoderStale = false;
+	m_stepFrames     = 1;  // show it even while paused
+
+	if ( m_isReversing ) {
+		m_reverseDecoder.setPlayhead( frame, m_loopState.load() == OF_LOOP_NORMAL );
+		return;
+	}
+	if ( !seekDecoder( frame ) ) {
+		stopDecoder();
+		startDecoder( frame );
+	}
+}
+
+// -----------------------------------------------------------------
+void Player::setSpeed( float speed )
+{
+	m_speed = speed;
+	if ( !m_isLoaded ) return;
+
+	if ( speed < 0.f && !m_isReversing ) {
+		startReverse();
+	} else if ( speed > 0.f && m_isReversing ) {
+		stopReverse();
+	}
+}
+
+// -----------------------------------------------------------------
+void Player::setLoopState( ofLoopType loopState )
+{
+	m_loopState = loopState;
+}
+
+// -----------------------------------------------------------------
+void Player::firstFrame()
+{
+	setFrame( 0 );
+}
+
+// -----------------------------------------------------------------
+void Player::nextFrame()
+{
+	// reversing, the frame after the current one has to be decoded again anyway
+	if ( m_isReversing ) {
+		setFrame( m_currentFrame + 1 );
+		return;
+	}
+	// a cached frame is shown right away, without waiting for the decoder
+	if ( m_settings.frameCache && m_stepFrames == 0 && m_settings.frameCache->contains( m_cacheKey, m_currentFrame + 1 ) ) {
+		setFrame( m_currentFrame + 1 );
+		return;
+	}
+	++m_stepFrames;
+}
+
+// -----------------------------------------------------------------
+void Player::previousFrame()
+{
+	setFrame( m_currentFrame - 1 );
+}
+
+// -----------------------------------------------------------------
+void Player::startDecoder( int frame )
+{
+	m_isDecoding    = true;
+	m_isDecoderDone = false;
+	m_decodeIndex   = frame;
+	m_skipUntil     = frame;
+	m_decoderThread = std::thread( &Player::processDecoder, this, frame );
+}
+
+// -----------------------------------------------------------------
+void Player::stopDecoder()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_ringMutex );
+		m_isDecoding = false;
+		for ( int pid : m_decoderPids ) {
+			killProcess( pid );  // unblocks the read - on windows it returns with the next frame
+		}
+		m_ringCondition.notify_all();
+	}
+
+	if ( m_decoderThread.joinable() ) m_decoderThread.join();
+
+	m_ringHead      = 0;
+	m_ringSize      = 0;
+	m_isDecoderDone = false;
+}
+
+// -----------------------------------------------------------------
+bool Player::seekDecoder( int frame )
+{
+	if ( !m_isDecoding ) return false;
+
+	const auto index = getKeyframeIndex();
+	std::lock_guard<std::mutex> lock( m_ringMutex );
+	if ( m_isDecoderDone ) return false;
+
+	// already decoded
+	for ( size_t i = 0; i < m_ringSize; ++i ) {
+		if ( m_ring[( m_ringHead + i ) % m_ring.size()].index == frame ) {
+			m_nDiscardedFrames += i;
+			m_ringHead = ( m_ringHead + i ) % m_ring.size();
+			m_ringSize -= i;
+			m_ringCondition.notify_all();
+			++m_nBufferedSeeks;
+			return true;
+		}
+	}
+
+	// ahead of the decoder, and decoding forward to it is faster than starting ffmpeg again at the keyframe before it
+	// without an index, restarts are assumed to start right at frame, which favours them
+	const int keyframe      = index ? index->getKeyframeBefore( frame ) : frame;
+	const float forwardCost = ( frame - m_decodeIndex ) * m_decodeTime;
+	const float restartCost = m_spawnTime + std::max( 0, frame - keyframe ) * m_decodeTime;
+	if ( frame >= m_decodeIndex && forwardCost <= restartCost ) {
+		m_nDiscardedFrames += m_ringSize;
+		m_ringHead  = ( m_ringHead + m_ringSize ) % m_ring.size();
+		m_ringSize  = 0;
+		m_skipUntil = frame;
+		m_ringCondition.notify_all();
+		++m_nForwardSeeks;
+		return true;
+	}
+
+	return false;
+}
+
+// -----------------------------------------------------------------
+void Player::startReverse()
+{
+	stopDecoder();
+	m_isDecoderStale = false;
+
+	const auto index = getKeyframeIndex();
+	ReverseDecoderSettings settings;
+	settings.width       = m_info.width;
+	settings.height      = m_info.height;
+	settings.pixelFormat = m_settings.pixelFormat;
+	settings.numFrames   = getTotalNumFrames();
+	settings.index       = index;
+	settings.command     = [this, index]( int frame, int nFrames ) { return getDecoderCommand( frame, index.get(), nFrames ); };
+	settings.threads     = m_settings.reverseThreads;
+	settings.chunks      = m_settings.reverseChunks;
+	settings.chunkFrames = m_settings.reverseChunkFrames;
+	m_reverseDecoder.start( settings, m_currentFrame, m_loopState.load() == OF_LOOP_NORMAL );
+	m_isReversing = true;
+}
+
+// -----------------------------------------------------------------
+void Player::stopReverse()
+{
+	m_reverseDecoder.stop();
+	const ReverseDecoderStats stats = m_reverseDecoder.getStats();
+	m_nDecodedFrames += stats.framesDecoded;
+	m_nReverseChunks += stats.chunksDecoded;
+
+	m_isReversing    = false;
+	m_isDecoderStale = true;
+}
+
+// -----------------------------------------------------------------
+void Player::updateReverse()
+{
+	const int nDue = int( m_dueFrames );
+	if ( nDue == 0 && m_stepFrames == 0 ) return;
+
+	int frame = m_currentFrame - nDue;
+	if ( frame < 0 ) {
+		const ofLoopType loopState = m_loopState.load();
+		if ( loopState == OF_LOOP_PALINDROME ) {
+			m_speed = -m_speed;
+			stopReverse();
+			return;
+		}
+		if ( loopState == OF_LOOP_NONE && m_currentFrame == 0 && m_stepFrames == 0 ) {
+			m_isMovieDone = true;
+			m_dueFrames   = 0.;
+			return;
+		}
+		frame = loopState == OF_LOOP_NONE ? 0 : std::max( 0, frame + getTotalNumFrames() );
+	}
+
+	m_reverseDecoder.setPlayhead( frame, m_loopState.load() == OF_LOOP_NORMAL );
+	if ( !m_reverseDecoder.takeFrame( frame, m_pixels ) ) return;  // its chunk isn't decoded yet, the current frame is held
+
+	m_currentFrame = frame;
+	m_isFrameNew   = true;
+	m_nSkippedFrames += std::max( 0, nDue - 1 );
+	m_dueFrames -= nDue;
+	m_stepFrames = 0;
+
+	if ( m_isSeeking ) {
+		m_seekLatency.add( Clock::now() - m_seekTime );
+		m_isSeeking = false;
+	}
+	setPrefetchCenter( frame );
+}
+
+// -----------------------------------------------------------------
+void Player::startPrefetch()
+{
+	if ( !m_settings.frameCache || m_settings.prefetchFrames <= 0 || m_settings.prefetchThreads == 0 ) return;
+
+	m_isPrefetching  = true;
+	m_prefetchCenter = m_currentFrame;
+	m_prefetchRanges.assign( m_settings.prefetchThreads, { 0, -1 } );
+	m_prefetchPids.assign( m_settings.prefetchThreads, -1 );
+	for ( size_t i = 0; i < m_settings.prefetchThreads; ++i ) {
+		m_prefetchThreads.emplace_back( &Player::processPrefetch, this, i );
+	}
+}
+
+// -----------------------------------------------------------------
+void Player::stopPrefetch()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_prefetchMutex );
+		m_isPrefetching = false;
+		for ( int pid : m_prefetchPids ) {
+			killProcess( pid );
+		}
+		m_prefetchCondition.notify_all();
+	}
+
+	for ( auto &thread : m_prefetchThreads ) {
+		thread.join();
+	}
+	m_prefetchThreads.clear();
+	m_prefetchRanges.clear();
+	m_prefetchPids.clear();
+}
+
+// -----------------------------------------------------------------
+void Player::setPrefetchCenter( int frame )
+{
+	if ( !m_isPrefetching || m_prefetchCenter == frame ) return;
+
+	std::lock_guard<std::mutex> lock( m_prefetchMutex );
+	m_prefetchCenter = frame;
+	++m_prefetchVersion;
+	m_prefetchCondition.notify_all();
+}
+
+// -----------------------------------------------------------------
+bool Player::findPrefetchRange( int &first, int &last ) const
+{
+	const auto &cache   = m_settings.frameCache;
+	const auto index    = getKeyframeIndex();
+	const int radius    = m_settings.prefetchFrames;
+	const int center    = m_prefetchCenter;
+	const int lastFrame = getTotalNumFrames() - 1;
+
+	auto isWanted = [&]( int frame ) {
+		if ( frame < std::max( 0, center - radius ) || frame > std::min( lastFrame, center + radius ) ) return false;
+		for ( const auto &range : m_prefetchRanges ) {
+			if ( frame >= range.first && frame <= range.second ) return false;
+		}
+		return !cache->contains( m_cacheKey, frame );
+	};
+
+	// the nearest missing frame, alternating ahead of and behind the playhead
+	for ( int distance = 0; distance <= radius; ++distance ) {
+		for ( int frame : { center + distance, center - distance } ) {
+			if ( !isWanted( frame ) ) continue;
+
+			// grown to the missing frames around it that decode from the same keyframe - without an index, a second's
+			// worth of frames is assumed to be a GOP
+			const int gop      = std::max( 1, int( m_info.fps ) );
+			const int keyframe = index ? index->getKeyframeBefore( frame ) : frame - frame % gop;
+			const int next     = index ? index->getKeyframeAfter( frame ) : keyframe + gop;
+			for ( first = frame; first > keyframe && isWanted( first - 1 ); --first ) {
+			}
+			for ( last = frame; last + 1 < next && isWanted( last + 1 ); ++last ) {
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+// -----------------------------------------------------------------
+void Player::processPrefetch( size_t worker )
+{
+	const auto &cache      = m_settings.frameCache;
+	const size_t frameSize = size_t( m_info.width ) * m_info.height * ( m_settings.pixelFormat == OF_PIXELS_RGBA ? 4 : 3 );
+	uint64_t version       = 0;
+
+	auto waitForPlayhead = [&]( std::unique_lock<std::mutex> &lock ) {
+		m_prefetchCondition.wait( lock, [&] { return m_prefetchVersion != version || !m_isPrefetching; } );
+		version = m_prefetchVersion;
+	};
+
+	std::unique_lock<std::mutex> lock( m_prefetchMutex );
+	while ( m_isPrefetching ) {
+		int first = 0, last = 0;
+		if ( !findPrefetchRange( first, last ) ) {
+			waitForPlayhead( lock );  // everything around it is cached or being decoded
+			continue;
+		}
+
+		m_prefetchRanges[worker] = { first, last };
+		lock.unlock();
+
+		const std::string cmd = getDecoderCommand( first, getKeyframeIndex().get(), last - first + 1 );
+		LOG_VERBOSE() << "Prefetching frames " << first << " to " << last << " with command...\n\t" << cmd << "\n";
+
+		int pid          = -1;
+		bool isTruncated = false;
+		FILE *pipe       = openProcess( cmd, pid, ProcessPipe::Stdout );
+		if ( pipe ) {
+			{
+				std::lock_guard<std::mutex> pidLock( m_prefetchMutex );
+				m_prefetchPids[worker] = pid;
+				if ( !m_isPrefetching ) killProcess( pid );  // stopPrefetch() came first
+			}
+
+			// given up once the playhead has moved well away, the frames would be evicted before they're shown
+			for ( int frame = first; frame <= last && m_isPrefetching; ++frame ) {
+				if ( std::abs( frame - m_prefetchCenter ) > 2 * m_settings.prefetchFrames ) break;
+
+				ofPixels pixels = cache->acquire( m_info.width, m_info.height, m_settings.pixelFormat );
+				if ( readProcess( pipe, pixels.getData(), frameSize ) < frameSize ) {
+					isTruncated = m_isPrefetching;
+					break;
+				}
+				cache->put( m_cacheKey, frame, std::move( pixels ) );
+				++m_nPrefetchedFrames;
+			}
+
+			{
+				std::lock_guard<std::mutex> pidLock( m_prefetchMutex );
+				killProcess( m_prefetchPids[worker] );  // done, or its remaining frames aren't wanted
+				m_prefetchPids[worker] = -1;
+			}
+			closeProcess( pipe, pid );
+		} else {
+			LOG_ERROR() << "Unable to start ffmpeg for " << m_info.path;
+		}
+
+		lock.lock();
+		m_prefetchRanges[worker] = { 0, -1 };
+		if ( !pipe ) break;
+
+		// ffmpeg ended early, the frame count may have been estimated - trying again only helps somewhere else
+		if ( isTruncated ) waitForPlayhead( lock );
+	}
+}
+
+// -----------------------------------------------------------------
+std::string Player::getDecoderCommand( int frame, const KeyframeIndex *index, int nFrames, int bandY, int bandHeight ) const
+{
+	DecoderArgs decoder;
+	decoder.path        = m_info.path;
+	decoder.nFrames     = nFrames;
+	decoder.pixelFormat = m_settings.pixelFormat;
+	decoder.inputArgs   = m_settings.extraInputArgs;
+	decoder.outputArgs  = ( index ? "-vsync passthrough " : "" ) + m_settings.extraOutputArgs;  // one output frame per packet, like the index counts them
+
+	// with an index, ffmpeg's first frame is exactly frame, and frames are counted from it - none are dropped or
+	// duplicated to fit a frame rate. Otherwise seek half a frame early, so rounding can't skip frame
+	if ( index && frame > 0 ) {
+		decoder.seekTime       = index->getSeekTime( frame );
+		decoder.isAccurateSeek = !index->isKeyframe( frame );
+	} else if ( frame > 0 ) {
+		decoder.seekTime = ( frame - 0.5 ) / m_info.fps;
+	}
+
+	if ( bandHeight > 0 ) {
+		decoder.filter = "crop=" + std::to_string( m_info.width ) + ":" + std::to_string( bandHeight ) + ":0:" + std::to_string( bandY );  // one band of rows
+	}
+
+	return ofxFFmpeg::getDecoderCommand( m_settings.ffmpegPath, decoder );
+}
+
+// -----------------------------------------------------------------
+void Player::processDecoder( int frame )
+{
+	const size_t rowSize   = size_t( m_info.width ) * ( m_settings.pixelFormat == OF_PIXELS_RGBA ? 4 : 3 );
+	const size_t frameSize = rowSize * m_info.height;
+
+	// with decodeBands, each ffmpeg writes a band of rows, which is contiguous in the frame and read straight into its
+	// place in the slot. Bands are an even number of rows, so crop stays exact on chroma subsampled video
+	struct Band
+	{
+		FILE *pipe = nullptr;
+		int pid    = -1;
+		int y = 0, height = 0;  // 0 for the whole frame
+	};
+	std::vector<Band> bands;
+	if ( m_settings.decodeBands > 1 ) {
+		const int nBands     = int( std::min<size_t>( m_settings.decodeBands, m_info.height / 2 ) );
+		const int bandHeight = ( ( m_info.height + nBands - 1 ) / nBands + 1 ) & ~1;
+		for ( int y = 0; y < m_info.height; y += bandHeight ) {
+			bands.push_back( { nullptr, -1, y, std::min( bandHeight, m_info.height - y ) } );
+		}
+	} else {
+		bands.emplace_back();
+	}
+
+	bool isOpen     = false;
+	int target      = frame;  // where the next processes start
+	size_t nDecoded = 0;      // by the current processes
+	TimePoint spawnTime;
+
+	auto closeDecoder = [&] {
+		{
+			std::lock_guard<std::mutex> lock( m_ringMutex );
+			m_decoderPids.clear();
+		}
+		for ( auto &band : bands ) {
+			if ( band.pipe ) closeProcess( band.pipe, band.pid );  // the exit status doesn't matter, the frames have been read or aren't wanted
+			band.pipe = nullptr;
+		}
+		isOpen = false;
+	};
+
+	while ( m_isDecoding ) {
+		if ( !isOpen ) {
+			spawnTime = Clock::now();
+			isOpen    = true;
+			for ( auto &band : bands ) {
+				const std::string cmd = getDecoderCommand( target, getKeyframeIndex().get(), 0, band.y, band.height );
+				LOG_VERBOSE() << "Starting ffmpeg with command...\n\t" << cmd << "\n";
+
+				band.pipe = openProcess( cmd, band.pid, ProcessPipe::Stdout );
+				isOpen    = isOpen && band.pipe;
+			}
+			if ( !isOpen ) {
+				LOG_ERROR() << "Unable to start ffmpeg for " << m_info.path;
+				for ( const auto &band : bands ) {
+					if ( band.pipe ) killProcess( band.pid );
+				}
+				closeDecoder();
+				break;
+			}
+
+			std::lock_guard<std::mutex> lock( m_ringMutex );
+			m_decodeIndex = target;
+			m_skipUntil   = std::max( m_skipUntil, target );  // seekDecoder() may have moved it further already
+			nDecoded      = 0;
+			for ( const auto &band : bands ) {
+				m_decoderPids.push_back( band.pid );
+				if ( !m_isDecoding ) killProcess( band.pid );  // stopDecoder() came first
+			}
+			++m_nDecoderSpawns;
+		}
+
+		// wait for a free slot - only this thread writes behind the ring's end, so the slot can be filled without the lock
+		DecodedFrame *slot = nullptr;
+		{
+			std::unique_lock<std::mutex> lock( m_ringMutex );
+			m_ringCondition.wait( lock, [this] { return m_ringSize < m_ring.size() || !m_isDecoding; } );
+			if ( !m_isDecoding ) break;
+			slot = &m_ring[( m_ringHead + m_ringSize ) % m_ring.size()];
+		}
+
+		// swapped out by update(), someone may have reallocated the pixels
+		if ( slot->pixels.getTotalBytes() != frameSize ) {
+			slot->pixels.allocate( m_info.width, m_info.height, m_settings.pixelFormat );
+		}
+
+		// the other processes keep decoding their next band while one is read, the frame is complete with the last band
+		const TimePoint readTime = Clock::now();
+		bool isRead              = true;
+		for ( auto &band : bands ) {
+			const size_t size = band.height > 0 ? band.height * rowSize : frameSize;
+			isRead            = isRead && readProcess( band.pipe, slot->pixels.getData() + band.y * rowSize, size ) == size;
+		}
+		if ( !isRead ) {
+			// end of the file, or killed by stopDecoder()
+			closeDecoder();
+
+			if ( !m_isDecoding ) break;
+
+			std::lock_guard<std::mutex> lock( m_ringMutex );
+			if ( m_loopState.load() == OF_LOOP_NORMAL && ( nDecoded > 0 || target > 0 ) ) {
+				target      = 0;
+				m_skipUntil = 0;
+				continue;
+			}
+
+			m_isDecoderDone = true;
+			break;
+		}
+
+		// costs seekDecoder() weighs - a restart's first frame includes ffmpeg's own decoding from the keyframe, which
+		// overestimates it a bit, so it leans towards decoding forward
+		const float elapsed = Seconds( Clock::now() - ( nDecoded == 0 ? spawnTime : readTime ) ).count();
+		std::atomic<float> &cost = nDecoded == 0 ? m_spawnTime : m_decodeTime;
+		cost = cost * 0.8f + elapsed * 0.2f;
+
+		++nDecoded;
+		++m_nDecodedFrames;
+
+		int index = 0;
+		{
+			std::lock_guard<std::mutex> lock( m_ringMutex );
+			index = m_decodeIndex++;
+		}
+
+		// copied before the frame is published, update() may swap it out right after
+		if ( m_settings.frameCache ) m_settings.frameCache->put( m_cacheKey, index, slot->pixels );
+
+		std::lock_guard<std::mutex> lock( m_ringMutex );
+		slot->index = index;
+		if ( index < m_skipUntil ) {
+			++m_nDiscardedFrames;  // the slot is read into again
+			continue;
+		}
+		++m_ringSize;
+	}
+
+	if ( isOpen ) closeDecoder();
+}
+
+// -----------------------------------------------------------------
+void Player::processIndex( std::string path )
+{
+	auto index = std::make_shared<KeyframeIndex>();
+	if ( !index->build( path, m_settings.ffprobePath, &m_indexPid ) ) return;
+
+	if ( m_settings.cacheKeyframeIndex && !index->save( KeyframeIndex::getCachePath( path ) ) ) {
+		LOG_VERBOSE() << "Unable to cache the keyframe index next to " << path;
+	}
+
+	std::lock_guard<std::mutex> lock( m_indexMutex );
+	m_index = index;
+}
+
+}  // namespace ofxFFmpeg
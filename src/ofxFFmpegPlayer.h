@@ -0,0 +1,201 @@
+#pragma once
+#include "ofxFFmpegFrameCache.h"
+#include "ofxFFmpegHelpers.h"
+#include "ofxFFmpegKeyframeIndex.h"
+#include "ofxFFmpegProbe.h"
+#include "ofxFFmpegReverseDecoder.h"
+
+namespace ofxFFmpeg {
+
+struct PlayerSettings
+{
+	std::string ffmpegPath      = "ffmpeg";
+	std::string ffprobePath     = "ffprobe";
+	ofPixelFormat pixelFormat   = OF_PIXELS_RGB;  // OF_PIXELS_RGB or OF_PIXELS_RGBA
+	size_t decodeAhead          = 8;  // frames decoded ahead of the playhead - the ring is allocated once by load()
+	std::string extraInputArgs  = "";  // e.g. -hwaccel auto
+	std::string extraOutputArgs = "";  // e.g. -vf scale=640:-2 (the frame size is probed from the file, keep it)
+	std::shared_ptr<ProbeCache> probeCache = nullptr;  // load() skips ffprobe for files probed before, can be shared between players
+
+	// seeking - without an index, seeks are time based and ffmpeg decodes from whatever keyframe it finds
+	bool useKeyframeIndex   = true;  // start decoding exactly at the keyframe before a frame - built in the background by load()
+	bool cacheKeyframeIndex = true;  // keep the index next to the media (movie.mp4.keyframes.json), so it's only built once
+
+	// scrubbing - decoded frames are kept in the cache, and seeks to them don't touch ffmpeg
+	std::shared_ptr<FrameCache> frameCache = nullptr;  // can be shared between players
+	int prefetchFrames                     = 0;  // frames kept decoded on each side of the playhead, needs a frameCache
+	size_t prefetchThreads                 = 2;  // ffmpeg processes decoding them
+
+	// reverse playback - negative speeds decode GOP sized chunks in parallel, and show them backwards
+	size_t reverseThreads  = 2;   // ffmpeg processes decoding chunks ahead of the playhead
+	size_t reverseChunks   = 3;   // chunks held, including the one being shown
+	int reverseChunkFrames = 30;  // longer GOPs are split - memory is bounded to reverseChunks * reverseChunkFrames frames
+
+	// very large frames - forward playback runs one ffmpeg per horizontal band of the frame, each cropping its band, so
+	// pixel format conversion and the pipe are split between them. Every process still decodes whole frames, it only
+	// pays off once conversion and transfer are the bottleneck. extraOutputArgs can't add a -vf of its own
+	size_t decodeBands = 1;
+};
+
+struct PlayerStats
+{
+	uint64_t framesDecoded    = 0;  // read from ffmpeg
+	uint64_t framesDiscarded  = 0;  // decoded on the way to a seek target, or buffered when a seek went elsewhere
+	uint64_t framesSkipped    = 0;  // late frames the playhead passed without showing them
+	uint64_t decoderSpawns    = 0;  // ffmpeg processes started for loads, seeks and loops
+	uint64_t seeks            = 0;
+	uint64_t bufferedSeeks    = 0;  // served from frames that were already decoded
+	uint64_t forwardSeeks     = 0;  // served by the running ffmpeg, decoding forward instead of restarting
+	uint64_t cachedSeeks      = 0;  // served by the frame cache
+	uint64_t framesPrefetched = 0;  // decoded around the playhead into the frame cache
+	uint64_t reverseChunks    = 0;  // decoded for reverse playback
+	float seekLatencyP50      = 0.f;  // seconds from setFrame() until update() shows the frame
+	float seekLatencyP90      = 0.f;
+	float seekLatencyP99      = 0.f;
+	float seekLatencyMax      = 0.f;
+	bool hasKeyframeIndex     = false;
+};
+
+/**
+ * Player decodes a file with ffmpeg into raw frames read back through its stdout. A background thread keeps up to
+ * decodeAhead frames ahead of the playhead in a ring of ofPixels allocated by load(), and update() swaps the due frame
+ * with the displayed one, so nothing is allocated or copied per frame.
+ * Use it on its own, or as the backend of an ofVideoPlayer for textures: video.setPlayer( std::make_shared<ofxFFmpeg::Player>() )
+ */
+class Player : public ofBaseVideoPlayer
+{
+public:
+	Player();
+	~Player();
+
+	void setup( const PlayerSettings& settings );  // call before load()
+	const PlayerSettings& getSettings() const { return m_settings; }
+	const MediaInfo& getMediaInfo() const { return m_info; }
+	size_t getNumBufferedFrames() const;  // decoded and waiting for the playhead
+	bool hasKeyframeIndex() const { return getKeyframeIndex() != nullptr; }
+	PlayerStats getStats() const;  // cheap snapshot, reset by load()
+
+	bool load( std::string path ) override;
+	void close() override;
+	void update() override;
+
+	void play() override;
+	void stop() override;  // stops and rewinds to the first frame
+	void setPaused( bool isPaused ) override;
+
+	bool isFrameNew() const override { return m_isFrameNew; }
+	ofPixels& getPixels() override { return m_pixels; }
+	const ofPixels& getPixels() const override { return m_pixels; }
+	bool setPixelFormat( ofPixelFormat pixelFormat ) override;
+	ofPixelFormat getPixelFormat() const override { return m_settings.pixelFormat; }
+
+	float getWidth() const override { return float( m_info.width ); }
+	float getHeight() const override { return float( m_info.height ); }
+	bool isLoaded() const override { return m_isLoaded; }
+	bool isPlaying() const override { return m_isPlaying && !m_isPaused; }
+	bool isPaused() const override { return m_isPaused; }
+	bool getIsMovieDone() const override { return m_isMovieDone; }
+
+	float getPosition() const override;
+	float getDuration() const override { return m_info.duration; }
+	int getCurrentFrame() const override { return m_currentFrame; }
+	int getTotalNumFrames() const override;
+	float getSpeed() const override { return m_speed; }
+	ofLoopType getLoopState() const override { return m_loopState.load(); }
+
+	void setPosition( float position ) override;
+	void setFrame( int frame ) override;  // shows a cached or decoded frame, decodes forward to it, or restarts decoding at its keyframe
+	void setSpeed( float speed ) override;  // negative plays in reverse, 0 holds the current frame
+	void setLoopState( ofLoopType loopState ) override;  // OF_LOOP_PALINDROME flips the sign of the speed at either end
+
+	void firstFrame() override;
+	void nextFrame() override;
+	void previousFrame() override;
+
+protected:
+	PlayerSettings m_settings;
+	MediaInfo m_info;
+	ofPixels m_pixels;  // the displayed frame
+	bool m_isLoaded = false, m_isPlaying = false, m_isPaused = false, m_isFrameNew = false, m_isMovieDone = false;
+	int m_currentFrame = 0;
+	float m_speed      = 1.f;
+	std::atomic<ofLoopType> m_loopState { OF_LOOP_NORMAL };
+
+	// playhead
+	TimePoint m_lastUpdateTime;
+	double m_dueFrames = 0.;  // frames the playhead has moved past since they were last taken from the ring
+	size_t m_stepFrames = 0;  // frames to show regardless of the clock - the first one after a seek, nextFrame()
+
+	// decoded frames, written by the decoder thread from the back, taken by update() from the front
+	struct DecodedFrame
+	{
+		ofPixels pixels;
+		int index = 0;
+	};
+	std::vector<DecodedFrame> m_ring;
+	size_t m_ringHead = 0, m_ringSize = 0;
+	mutable std::mutex m_ringMutex;
+	std::condition_variable m_ringCondition;
+
+	// decoder
+	std::thread m_decoderThread;
+	std::atomic<bool> m_isDecoding { false };
+	bool m_isDecoderDone = false;  // reached the end of the file without looping, guarded by m_ringMutex
+	int m_decodeIndex    = 0;      // the frame the decoder reads next, guarded by m_ringMutex
+	int m_skipUntil      = 0;      // frames before it are read and discarded, guarded by m_ringMutex
+	std::vector<int> m_decoderPids;  // one per band, guarded by m_ringMutex, so they're never killed after they've been reaped
+	std::atomic<float> m_decodeTime { 0.005f };  // seconds per frame read, averaged
+	std::atomic<float> m_spawnTime { 0.1f };     // seconds from starting ffmpeg to its first frame, averaged
+
+	// keyframe index, immutable once it's set
+	std::shared_ptr<const KeyframeIndex> m_index;
+	mutable std::mutex m_indexMutex;
+	std::thread m_indexThread;
+	std::atomic<int> m_indexPid { -1 };  // ffprobe building the index, killed by close()
+
+	// frame cache
+	std::string m_cacheKey;           // the path, and the settings that change decoded frames
+	bool m_isCachedFrameNew = false;  // setFrame() showed a cached frame, reported by the next update()
+	bool m_isDecoderStale   = false;  // the decoder isn't at the playhead since then, it's moved when frames are due
+
+	// reverse playback, in place of the decoder while the speed is negative
+	ReverseDecoder m_reverseDecoder;
+	bool m_isReversing = false;
+
+	// prefetch workers, decoding the missing frames nearest to the playhead
+	std::vector<std::thread> m_prefetchThreads;
+	std::mutex m_prefetchMutex;
+	std::condition_variable m_prefetchCondition;
+	std::atomic<bool> m_isPrefetching { false };
+	std::atomic<int> m_prefetchCenter { 0 };
+	uint64_t m_prefetchVersion = 0;                     // bumped when the playhead moves, guarded by m_prefetchMutex
+	std::vector<std::pair<int, int>> m_prefetchRanges;  // frames each worker is decoding, guarded by m_prefetchMutex
+	std::vector<int> m_prefetchPids;                    // guarded by m_prefetchMutex
+
+	// stats
+	bool m_isSeeking = false;
+	int m_seekFrame  = 0;
+	TimePoint m_seekTime;
+	LatencyHistogram m_seekLatency;
+	std::atomic<uint64_t> m_nDecodedFrames { 0 }, m_nDiscardedFrames { 0 }, m_nSkippedFrames { 0 }, m_nDecoderSpawns { 0 };
+	std::atomic<uint64_t> m_nSeeks { 0 }, m_nBufferedSeeks { 0 }, m_nForwardSeeks { 0 }, m_nCachedSeeks { 0 };
+	std::atomic<uint64_t> m_nPrefetchedFrames { 0 }, m_nReverseChunks { 0 };
+
+	void startDecoder( int frame );
+	void stopDecoder();  // also clears the ring
+	bool seekDecoder( int frame );  // moves the running decoder to frame, if that's cheaper than restarting it
+	void processDecoder( int frame );
+	void processIndex( std::string path );
+	void startReverse();
+	void stopReverse();  // the decoder continues after the current frame once frames are due
+	void updateReverse();
+	void startPrefetch();
+	void stopPrefetch();
+	void setPrefetchCenter( int frame );
+	void processPrefetch( size_t worker );
+	bool findPrefetchRange( int& first, int& last ) const;  // needs m_prefetchMutex
+	std::string getDecoderCommand( int frame, const KeyframeIndex* index, int nFrames = 0, int bandY = 0, int bandHeight = 0 ) const;  // all frames and rows if 0
+	std::shared_ptr<const KeyframeIndex> getKeyframeIndex() const;
+};
+
+}  // namespace ofxFFmpeg
@@ -0,0 +1,257 @@
+#include "ofxFFmpegPlaylist.h"
+// openFrameworks
+#include "ofLog.h"
+
+// Logging macros
+#define LOG_ERROR() ofLogError( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+#define LOG_WARNING() ofLogWarning( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+#define LOG_VERBOSE() ofLogVerbose( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+
+namespace ofxFFmpeg {
+
+// -----------------------------------------------------------------
+Playlist::~Playlist()
+{
+	cancelPreroll();
+}
+
+// -----------------------------------------------------------------
+void Playlist::setup( const PlaylistSettings &settings )
+{
+	m_settings = settings;
+}
+
+// -----------------------------------------------------------------
+void Playlist::setItems( const std::vector<std::string> &paths )
+{
+	cancelPreroll();
+	m_current.reset();
+	m_items       = paths;
+	m_currentItem = 0;
+	m_isPlaying   = false;
+	m_isStalled   = false;
+	m_stats       = PlaylistStats();
+}
+
+// -----------------------------------------------------------------
+void Playlist::addItem( const std::string &path )
+{
+	m_items.push_back( path );
+
+	// a single item was looping on its own, or the last one was wrapping around to the first
+	if ( m_current ) configure( *m_current );
+	if ( m_next && m_nextItem != getItemAfter( m_currentItem ) ) cancelPreroll();
+}
+
+// -----------------------------------------------------------------
+bool Playlist::play()
+{
+	if ( !m_current && !load( m_currentItem ) ) return false;
+
+	m_isPlaying = true;
+	m_isPaused  = false;
+	m_current->play();
+	return true;
+}
+
+// -----------------------------------------------------------------
+void Playlist::stop()
+{
+	m_isPlaying = false;
+	m_isPaused  = false;
+	m_isStalled = false;
+	cancelPreroll();
+	if ( m_current ) m_current->stop();
+}
+
+// -----------------------------------------------------------------
+void Playlist::setPaused( bool isPaused )
+{
+	m_isPaused = isPaused;
+	if ( m_current ) m_current->setPaused( isPaused );
+}
+
+// -----------------------------------------------------------------
+void Playlist::setSpeed( float speed )
+{
+	if ( speed < 0.f ) {
+		LOG_WARNING() << "Playlists only play forward";
+		speed = 0.f;
+	}
+	m_speed = speed;
+	if ( m_current ) configure( *m_current );
+}
+
+// -----------------------------------------------------------------
+void Playlist::update()
+{
+	if ( !m_current ) return;
+	m_current->update();
+	if ( !m_isPlaying || m_isPaused ) return;
+
+	// the next item starts loading while there's time left
+	const size_t next = getItemAfter( m_currentItem );
+	if ( !m_next && next < m_items.size() && next != m_currentItem && getRemainingTime() <= m_settings.prerollTime ) {
+		preroll( next );
+	}
+	finishPreroll( false );  // a file that fails to load is skipped right away, while there's still time for the one after it
+
+	if ( !m_current->getIsMovieDone() ) return;
+
+	if ( !m_next ) {
+		if ( next >= m_items.size() ) m_isPlaying = false;  // the end of the playlist
+		return;
+	}
+
+	// hold the last frame until the next item's first one is decoded
+	if ( !finishPreroll( false ) || m_next->getNumBufferedFrames() == 0 ) {
+		if ( !m_isStalled ) m_stallBegin = Clock::now();
+		m_isStalled = true;
+		return;
+	}
+
+	switchToNext();
+}
+
+// -----------------------------------------------------------------
+bool Playlist::setItem( size_t item )
+{
+	if ( item >= m_items.size() ) return false;
+
+	if ( m_next && m_nextItem == item && finishPreroll( true ) ) {
+		switchToNext();
+		return true;
+	}
+	return load( item );
+}
+
+// -----------------------------------------------------------------
+bool Playlist::nextItem()
+{
+	const size_t next = getItemAfter( m_currentItem );
+	return next < m_items.size() && setItem( next );
+}
+
+// -----------------------------------------------------------------
+bool Playlist::previousItem()
+{
+	if ( m_items.empty() ) return false;
+	if ( m_currentItem == 0 && !m_settings.isLooping ) return false;
+	return setItem( m_currentItem > 0 ? m_currentItem - 1 : m_items.size() - 1 );
+}
+
+// -----------------------------------------------------------------
+bool Playlist::load( size_t item )
+{
+	if ( item >= m_items.size() ) return false;
+
+	cancelPreroll();
+	m_isStalled = false;
+
+	auto player = std::make_unique<Player>();
+	player->setup( m_settings.player );
+	configure( *player );
+	if ( !player->load( m_items[item] ) ) {
+		LOG_ERROR() << "Unable to load item " << item << ": " << m_items[item];
+		return false;
+	}
+
+	m_current     = std::move( player );
+	m_currentItem = item;
+	if ( m_isPlaying ) m_current->play();
+	m_current->setPaused( m_isPaused );
+
+	if ( m_settings.onItemChanged ) m_settings.onItemChanged( m_currentItem );
+	return true;
+}
+
+// -----------------------------------------------------------------
+void Playlist::preroll( size_t item )
+{
+	LOG_VERBOSE() << "Pre-rolling item " << item << ": " << m_items[item];
+
+	m_next     = std::make_unique<Player>();
+	m_nextItem = item;
+	m_next->setup( m_settings.player );
+	configure( *m_next );  // the loop state before its decoder can reach the end
+
+	// loading probes the file and starts ffmpeg, which fills the player's ring with the first frames meanwhile
+	Player *player         = m_next.get();
+	const std::string path = m_items[item];
+	m_nextLoad             = std::async( std::launch::async, [player, path] { return player->load( path ); } );
+}
+
+// -----------------------------------------------------------------
+bool Playlist::finishPreroll( bool wait )
+{
+	if ( !m_next ) return false;
+	if ( !m_nextLoad.valid() ) return true;  // finished before
+	if ( !wait && m_nextLoad.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready ) return false;
+
+	if ( m_nextLoad.get() ) return true;
+
+	// skipped
+	LOG_ERROR() << "Unable to load item " << m_nextItem << ": " << m_items[m_nextItem] << ", skipping it";
+	const size_t failed = m_nextItem;
+	m_next.reset();
+
+	const size_t next = getItemAfter( failed );
+	if ( next < m_items.size() && next != m_currentItem ) preroll( next );
+	return false;
+}
+
+// -----------------------------------------------------------------
+void Playlist::cancelPreroll()
+{
+	if ( m_nextLoad.valid() ) m_nextLoad.wait();
+	m_nextLoad = std::future<bool>();
+	m_next.reset();
+}
+
+// -----------------------------------------------------------------
+void Playlist::switchToNext()
+{
+	if ( m_isStalled ) {
+		m_stats.maxStall = std::max( m_stats.maxStall, Seconds( Clock::now() - m_stallBegin ).count() );
+		++m_stats.lateSwitches;
+	} else {
+		++m_stats.gaplessSwitches;
+	}
+	++m_stats.switches;
+	m_isStalled = false;
+
+	// the finished player's decoder has already exited, so closing it doesn't wait
+	m_current     = std::move( m_next );
+	m_currentItem = m_nextItem;
+	configure( *m_current );
+	if ( m_isPlaying ) m_current->play();
+	m_current->setPaused( m_isPaused );
+	m_current->update();  // shows the first frame, it's decoded already
+
+	if ( m_settings.onItemChanged ) m_settings.onItemChanged( m_currentItem );
+}
+
+// -----------------------------------------------------------------
+void Playlist::configure( Player &player ) const
+{
+	// a single item loops within its own decoder
+	player.setLoopState( m_items.size() == 1 && m_settings.isLooping ? OF_LOOP_NORMAL : OF_LOOP_NONE );
+	player.setSpeed( m_speed );
+}
+
+// -----------------------------------------------------------------
+size_t Playlist::getItemAfter( size_t item ) const
+{
+	if ( item + 1 < m_items.size() ) return item + 1;
+	return m_settings.isLooping && !m_items.empty() ? 0 : m_items.size();
+}
+
+// -----------------------------------------------------------------
+float Playlist::getRemainingTime() const
+{
+	const float fps = m_current->getMediaInfo().fps * m_speed;
+	if ( fps <= 0.f ) return std::numeric_limits<float>::max();  // paused by a speed of 0
+	return ( m_current->getTotalNumFrames() - 1 - m_current->getCurrentFrame() ) / fps;
+}
+
+}  // namespace ofxFFmpeg
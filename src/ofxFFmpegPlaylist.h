@@ -0,0 +1,86 @@
+#pragma once
+#include "ofxFFmpegPlayer.h"
+
+namespace ofxFFmpeg {
+
+struct PlaylistSettings
+{
+	PlayerSettings player;     // for every item
+	float prerollTime = 2.f;   // seconds before an item ends that the next one is loaded and starts decoding
+	bool isLooping    = true;  // back to the first item after the last one
+	std::function<void( size_t item )> onItemChanged = nullptr;  // called from update() when an item's first frame is shown
+};
+
+struct PlaylistStats
+{
+	uint64_t switches        = 0;
+	uint64_t gaplessSwitches = 0;    // the next item's first frame was decoded by the time the current one ended
+	uint64_t lateSwitches    = 0;    // it wasn't, and the last frame was held until it was
+	float maxStall           = 0.f;  // seconds the last frame was held, at worst
+};
+
+/**
+ * Playlist plays files back to back without a gap. prerollTime before an item ends, a second Player loads the next one
+ * on a background thread, so ffprobe and ffmpeg have started and its first frames are decoded by the time it's due.
+ * The update() that finds the current item done then shows the next item's first frame, on the exact frame.
+ */
+class Playlist
+{
+public:
+	~Playlist();
+
+	void setup( const PlaylistSettings& settings );  // call before play()
+	const PlaylistSettings& getSettings() const { return m_settings; }
+	void setItems( const std::vector<std::string>& paths );  // stops playback
+	void addItem( const std::string& path );
+	const std::vector<std::string>& getItems() const { return m_items; }
+	PlaylistStats getStats() const { return m_stats; }
+
+	bool play();  // loads the current item first, if it isn't
+	void stop();  // stops and rewinds the current item
+	void setPaused( bool isPaused );
+	void setSpeed( float speed );  // forward only
+	void update();
+
+	bool setItem( size_t item );  // blocks while the item loads, unless it's the one being pre-rolled
+	bool nextItem();
+	bool previousItem();
+	size_t getCurrentItem() const { return m_currentItem; }
+
+	bool isFrameNew() const { return m_current && m_current->isFrameNew(); }
+	ofPixels& getPixels() { return m_current ? m_current->getPixels() : m_emptyPixels; }
+	const ofPixels& getPixels() const { return m_current ? m_current->getPixels() : m_emptyPixels; }
+	Player* getPlayer() { return m_current.get(); }  // the current item's, nullptr until it's loaded
+	bool isPlaying() const { return m_isPlaying && !m_isPaused; }
+	bool isPaused() const { return m_isPaused; }
+
+protected:
+	PlaylistSettings m_settings;
+	std::vector<std::string> m_items;
+	ofPixels m_emptyPixels;
+	bool m_isPlaying = false, m_isPaused = false;
+	float m_speed    = 1.f;
+
+	std::unique_ptr<Player> m_current;
+	size_t m_currentItem = 0;
+
+	// the pre-rolled item, loaded by m_nextLoad - the player isn't touched until it's done
+	std::unique_ptr<Player> m_next;
+	size_t m_nextItem = 0;
+	std::future<bool> m_nextLoad;
+
+	PlaylistStats m_stats;
+	bool m_isStalled = false;
+	TimePoint m_stallBegin;
+
+	bool load( size_t item );  // into m_current, blocking
+	void preroll( size_t item );
+	bool finishPreroll( bool wait );  // whether m_next loaded, a failed one is dropped
+	void cancelPreroll();
+	void switchToNext();
+	void configure( Player& player ) const;
+	size_t getItemAfter( size_t item ) const;  // m_items.size() after the last one without looping
+	float getRemainingTime() const;            // seconds until the current item ends
+};
+
+}  // namespace ofxFFmpeg
@@ -0,0 +1,306 @@
+#include "ofxFFmpegProbe.h"
+#include "ofxFFmpegProcess.h"
+// openFrameworks
+#include "ofFileUtils.h"
+#include "ofLog.h"
+#include "ofUtils.h"
+
+#include <sys/stat.h>
+
+namespace ofxFFmpeg {
+
+namespace {
+
+	// ffprobe writes rates as fractions, like 30000/1001
+	float parseRate( const std::string &rate )
+	{
+		const size_t slash = rate.find( '/' );
+		if ( slash == std::string::npos ) return std::strtof( rate.c_str(), nullptr );
+
+		const float num = std::strtof( rate.substr( 0, slash ).c_str(), nullptr );
+		const float den = std::strtof( rate.substr( slash + 1 ).c_str(), nullptr );
+		return den > 0.f ? num / den : 0.f;
+	}
+
+	// numbers come as strings, and are missing when the container doesn't know them
+	float getFloat( const ofJson &json, const std::string &key )
+	{
+		if ( !json.contains( key ) ) return 0.f;
+		return json[key].is_string() ? std::strtof( json[key].get<std::string>().c_str(), nullptr ) : json[key].get<float>();
+	}
+
+	ofJson toJson( const MediaInfo &info )
+	{
+		ofJson streams = ofJson::array();
+		for ( const auto &stream : info.streams ) {
+			streams.push_back( {
+			    { "index", stream.index },
+			    { "type", stream.type },
+			    { "codec", stream.codec },
+			    { "width", stream.width },
+			    { "height", stream.height },
+			    { "channels", stream.channels },
+			    { "sampleRate", stream.sampleRate },
+			} );
+		}
+
+		return {
+		    { "codec", info.codec },
+		    { "width", info.width },
+		    { "height", info.height },
+		    { "fps", info.fps },
+		    { "duration", info.duration },
+		    { "frames", info.numFrames },
+		    { "streams", streams },
+		};
+	}
+
+	MediaInfo fromJson( const std::string &path, const ofJson &json )
+	{
+		MediaInfo info;
+		info.path      = path;
+		info.codec     = json.value( "codec", "" );
+		info.width     = json.value( "width", 0 );
+		info.height    = json.value( "height", 0 );
+		info.fps       = json.value( "fps", 0.f );
+		info.duration  = json.value( "duration", 0.f );
+		info.numFrames = json.value( "frames", 0 );
+		for ( const auto &stream : json.value( "streams", ofJson::array() ) ) {
+			StreamInfo streamInfo;
+			streamInfo.index      = stream.value( "index", 0 );
+			streamInfo.type       = stream.value( "type", "" );
+			streamInfo.codec      = stream.value( "codec", "" );
+			streamInfo.width      = stream.value( "width", 0 );
+			streamInfo.height     = stream.value( "height", 0 );
+			streamInfo.channels   = stream.value( "channels", 0 );
+			streamInfo.sampleRate = stream.value( "sampleRate", 0 );
+			info.streams.push_back( streamInfo );
+		}
+		return info;
+	}
+}  // namespace
+
+// -----------------------------------------------------------------
+MediaInfo probeMedia( const std::string &path, const std::string &ffprobePath )
+{
+	MediaInfo info;
+	info.path = path;
+
+	const std::string cmd = ( ffprobePath.empty() ? "ffprobe" : ffprobePath ) +
+	                        " -v error"
+	                        " -show_entries stream=index,codec_type,codec_name,width,height,r_frame_rate,avg_frame_rate,nb_frames,duration,channels,sample_rate"
+	                        " -show_entries format=duration"  // for streams that don't have one
+	                        " -of json"
+	                        " " + quoteArg( path );
+
+	const std::string output = getProcessOutput( cmd );
+	if ( output.empty() ) {
+		ofLogError( "ofxFFmpeg" ) << __FUNCTION__ << ": Unable to probe " << path;
+		return info;
+	}
+
+	try {
+		const ofJson json    = ofJson::parse( output );
+		const ofJson streams = json.value( "streams", ofJson::array() );
+		for ( const auto &stream : streams ) {
+			StreamInfo streamInfo;
+			streamInfo.index      = stream.value( "index", int( info.streams.size() ) );
+			streamInfo.type       = stream.value( "codec_type", "" );
+			streamInfo.codec      = stream.value( "codec_name", "" );
+			streamInfo.width      = stream.value( "width", 0 );
+			streamInfo.height     = stream.value( "height", 0 );
+			streamInfo.channels   = stream.value( "channels", 0 );
+			streamInfo.sampleRate = int( getFloat( stream, "sample_rate" ) );
+			info.streams.push_back( streamInfo );
+		}
+
+		// the first video stream, which the player decodes
+		const auto video = std::find_if( streams.begin(), streams.end(), []( const ofJson &stream ) { return stream.value( "codec_type", "" ) == "video"; } );
+		if ( video == streams.end() ) {
+			ofLogError( "ofxFFmpeg" ) << __FUNCTION__ << ": No video stream in " << path;
+			return info;
+		}
+
+		const ofJson &stream = *video;
+		info.codec           = stream.value( "codec_name", "" );
+		info.width           = stream.value( "width", 0 );
+		info.height          = stream.value( "height", 0 );
+
+		// the average rate is the real one for variable frame rate files, r_frame_rate is the container's base rate
+		info.fps = parseRate( stream.value( "avg_frame_rate", "0/0" ) );
+		if ( info.fps <= 0.f ) info.fps = parseRate( stream.value( "r_frame_rate", "0/0" ) );
+
+		info.duration = getFloat( stream, "duration" );
+		if ( info.duration <= 0.f && json.contains( "format" ) ) info.duration = getFloat( json["format"], "duration" );
+
+		info.numFrames = int( getFloat( stream, "nb_frames" ) );
+		if ( info.numFrames <= 0 ) info.numFrames = int( std::round( info.duration * info.fps ) );
+	} catch ( const std::exception &e ) {
+		ofLogError( "ofxFFmpeg" ) << __FUNCTION__ << ": Unable to parse ffprobe output for " << path << ": " << e.what();
+		info = MediaInfo();
+		info.path = path;
+	}
+
+	return info;
+}
+
+// -----------------------------------------------------------------
+bool getFileStamp( const std::string &path, uint64_t &size, int64_t &time )
+{
+	struct stat info;
+	if ( stat( path.c_str(), &info ) != 0 ) return false;
+	size = uint64_t( info.st_size );
+	time = int64_t( info.st_mtime );
+	return true;
+}
+
+// -----------------------------------------------------------------
+ProbeCache::~ProbeCache()
+{
+	if ( m_isModified ) save();
+}
+
+// -----------------------------------------------------------------
+bool ProbeCache::setup( const std::string &cachePath, const std::string &ffprobePath )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_cachePath   = ofToDataPath( cachePath, true );
+	m_ffprobePath = ffprobePath;
+	m_entries.clear();
+	m_isModified = false;
+	m_stats      = ProbeCacheStats();
+
+	if ( !ofFile::doesFileExist( m_cachePath, false ) ) return false;
+
+	try {
+		const ofJson json = ofLoadJson( m_cachePath );
+		if ( json.value( "version", 0 ) != CacheVersion ) return false;
+
+		const ofJson media = json.value( "media", ofJson::object() );
+		for ( const auto &item : media.items() ) {
+			Entry entry;
+			entry.size = item.value().value( "size", uint64_t( 0 ) );
+			entry.time = item.value().value( "mtime", int64_t( 0 ) );
+			entry.info = fromJson( item.key(), item.value() );
+			m_entries[item.key()] = entry;
+		}
+	} catch ( const std::exception &e ) {
+		ofLogWarning( "ofxFFmpeg" ) << __FUNCTION__ << ": Unable to read " << m_cachePath << ": " << e.what();
+		m_entries.clear();
+		return false;
+	}
+
+	return true;
+}
+
+// -----------------------------------------------------------------
+bool ProbeCache::save()
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	if ( m_cachePath.empty() ) return false;
+
+	ofJson media = ofJson::object();
+	for ( const auto &entry : m_entries ) {
+		ofJson json        = toJson( entry.second.info );
+		json["size"]       = entry.second.size;
+		json["mtime"]      = entry.second.time;
+		media[entry.first] = json;
+	}
+
+	m_isModified = false;
+	return ofSaveJson( m_cachePath, { { "version", CacheVersion }, { "media", media } } );
+}
+
+// -----------------------------------------------------------------
+void ProbeCache::clear()
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	m_entries.clear();
+	m_isModified = true;
+}
+
+// -----------------------------------------------------------------
+MediaInfo ProbeCache::probe( const std::string &path )
+{
+	const std::string absolutePath = ofToDataPath( path, true );
+
+	uint64_t size       = 0;
+	int64_t time        = 0;
+	const bool hasStamp = getFileStamp( absolutePath, size, time );
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		const auto it = m_entries.find( absolutePath );
+		if ( hasStamp && it != m_entries.end() ) {
+			if ( it->second.size == size && it->second.time == time ) {
+				++m_stats.hits;
+				return it->second.info;
+			}
+			++m_stats.stale;
+		}
+		++m_stats.misses;
+	}
+
+	// failures aren't cached, ffprobe may only have been missing
+	const MediaInfo info = probeMedia( absolutePath, m_ffprobePath );
+	if ( hasStamp && info.isValid() ) {
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_entries[absolutePath] = { size, time, info };
+		m_isModified            = true;
+	}
+	return info;
+}
+
+// -----------------------------------------------------------------
+std::vector<MediaInfo> ProbeCache::probe( const std::vector<std::string> &paths, size_t threads )
+{
+	std::vector<MediaInfo> infos( paths.size() );
+	if ( paths.empty() ) return infos;
+
+	// hits return right away, so each worker takes the next path as soon as it's done with one
+	std::atomic<size_t> next { 0 };
+	auto process = [&] {
+		for ( size_t i = next++; i < paths.size(); i = next++ ) {
+			infos[i] = probe( paths[i] );
+		}
+	};
+
+	const size_t nThreads = std::min( paths.size(), std::max<size_t>( 1, threads > 0 ? threads : std::thread::hardware_concurrency() ) );
+	std::vector<std::thread> workers;
+	for ( size_t i = 1; i < nThreads; ++i ) {
+		workers.emplace_back( process );
+	}
+	process();
+	for ( auto &worker : workers ) {
+		worker.join();
+	}
+
+	return infos;
+}
+
+// -----------------------------------------------------------------
+std::vector<MediaInfo> ProbeCache::probeDirectory( const std::string &directory, const std::vector<std::string> &extensions, size_t threads )
+{
+	ofDirectory dir( ofToDataPath( directory, true ) );
+	for ( const auto &extension : extensions ) {
+		dir.allowExt( extension );
+	}
+	dir.listDir();
+	dir.sort();
+
+	std::vector<std::string> paths;
+	for ( const auto &file : dir.getFiles() ) {
+		if ( file.isFile() ) paths.push_back( file.getAbsolutePath() );
+	}
+	return probe( paths, threads );
+}
+
+// -----------------------------------------------------------------
+ProbeCacheStats ProbeCache::getStats() const
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	ProbeCacheStats stats = m_stats;
+	stats.entries         = m_entries.size();
+	return stats;
+}
+
+}  // namespace ofxFFmpeg
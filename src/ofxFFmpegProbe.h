@@ -0,0 +1,88 @@
+#pragma once
+#include "ofxFFmpegHelpers.h"
+
+#include <unordered_map>
+
+namespace ofxFFmpeg {
+
+// one stream of a file, as ffprobe lists them
+struct StreamInfo
+{
+	int index = 0;
+	std::string type;  // video, audio, subtitle, data or attachment
+	std::string codec;
+	int width      = 0;  // video
+	int height     = 0;
+	int channels   = 0;  // audio
+	int sampleRate = 0;
+};
+
+// what ffprobe reports about the first video stream of a file
+struct MediaInfo
+{
+	std::string path;
+	std::string codec;
+	int width      = 0;
+	int height     = 0;
+	float fps      = 0.f;
+	float duration = 0.f;  // seconds
+	int numFrames  = 0;    // counted by the container, or estimated from duration and fps
+	std::vector<StreamInfo> streams;  // every stream in the file, in order
+
+	bool isValid() const { return width > 0 && height > 0 && fps > 0.f; }
+};
+
+// runs ffprobe on path and blocks until it's done - check isValid() on the result
+MediaInfo probeMedia( const std::string& path, const std::string& ffprobePath = "ffprobe" );
+
+// the format of the JSON caches next to or about media - ProbeCache and KeyframeIndex files - bump it when either changes
+const int CacheVersion = 1;
+// size and modification time, to tell if a cached probe or index still belongs to the file
+bool getFileStamp( const std::string& path, uint64_t& size, int64_t& time );
+
+struct ProbeCacheStats
+{
+	uint64_t hits   = 0;
+	uint64_t misses = 0;  // probed with ffprobe
+	uint64_t stale  = 0;  // misses for files that changed since they were cached
+	size_t entries  = 0;
+};
+
+/**
+ * ProbeCache keeps probeMedia() results in a JSON file, keyed by the media's path along with its size and modification
+ * time, so a library of clips is only probed once - and again only for files that changed. Batches probe the misses in
+ * parallel. It's safe to share between threads, and between players with PlayerSettings::probeCache.
+ */
+class ProbeCache
+{
+public:
+	~ProbeCache();  // saves, if anything was probed since the last save()
+
+	bool setup( const std::string& cachePath, const std::string& ffprobePath = "ffprobe" );  // loads cachePath if it exists
+	bool save();
+	void clear();
+
+	MediaInfo probe( const std::string& path );  // blocks while ffprobe runs on a miss - check isValid() on the result
+	std::vector<MediaInfo> probe( const std::vector<std::string>& paths, size_t threads = 0 );  // 0 for one ffprobe per core
+	// every file in directory, or only those with one of extensions ( "mp4", "mov" )
+	std::vector<MediaInfo> probeDirectory( const std::string& directory, const std::vector<std::string>& extensions = {}, size_t threads = 0 );
+
+	ProbeCacheStats getStats() const;
+
+protected:
+	struct Entry
+	{
+		uint64_t size = 0;  // of the media when it was probed
+		int64_t time  = 0;
+		MediaInfo info;
+	};
+
+	std::string m_cachePath;
+	std::string m_ffprobePath = "ffprobe";
+	std::unordered_map<std::string, Entry> m_entries;  // by absolute path
+	mutable std::mutex m_mutex;
+	bool m_isModified = false;
+	ProbeCacheStats m_stats;
+};
+
+}  // namespace ofxFFmpeg
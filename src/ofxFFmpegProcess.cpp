@@ -0,0 +1,233 @@
+#include "ofxFFmpegProcess.h"
+
+#if defined( _WIN32 )
+#include <io.h>
+#else
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+namespace ofxFFmpeg {
+
+// -----------------------------------------------------------------
+FILE *openProcess( const std::string &cmd, int &pid, ProcessPipe direction )
+{
+	const bool isReading = direction == ProcessPipe::Stdout;
+
+#if defined( _WIN32 )
+	pid = -1;
+	return _popen( cmd.c_str(), isReading ? "rb" : "wb" );
+#else
+	// only the child's end stays open across exec, as stdin or stdout. Processes are spawned from many threads at once,
+	// so the ends have to be close-on-exec from the start - a pipe end inherited by another child keeps it from ever
+	// seeing EOF, and closeProcess() or a read waits forever
+	int fds[2];
+#if defined( __linux__ )
+	if ( pipe2( fds, O_CLOEXEC ) != 0 ) return nullptr;
+#else
+	// no pipe2(), hold every other spawn off until the flags are set
+	static std::mutex spawnMutex;
+	std::unique_lock<std::mutex> spawnLock( spawnMutex );
+	if ( pipe( fds ) != 0 ) return nullptr;
+	fcntl( fds[0], F_SETFD, FD_CLOEXEC );
+	fcntl( fds[1], F_SETFD, FD_CLOEXEC );
+#endif
+
+	const int childFd  = isReading ? fds[1] : fds[0];
+	const int parentFd = isReading ? fds[0] : fds[1];
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init( &actions );
+	posix_spawn_file_actions_adddup2( &actions, childFd, isReading ? STDOUT_FILENO : STDIN_FILENO );
+
+	const std::string shellCmd = "exec " + cmd;  // the process replaces the shell, so pid is its own
+	char *argv[]               = { const_cast<char *>( "sh" ), const_cast<char *>( "-c" ), const_cast<char *>( shellCmd.c_str() ), nullptr };
+	pid_t child                = -1;
+	const int error            = posix_spawn( &child, "/bin/sh", &actions, nullptr, argv, environ );
+	posix_spawn_file_actions_destroy( &actions );
+	close( childFd );
+
+	if ( error != 0 ) {
+		close( parentFd );
+		errno = error;
+		return nullptr;
+	}
+
+	if ( !isReading ) fcntl( parentFd, F_SETFL, O_NONBLOCK );  // writes wait in poll(), so they can time out
+	pid = child;
+	return fdopen( parentFd, isReading ? "r" : "w" );
+#endif
+}
+
+// -----------------------------------------------------------------
+int closeProcess( FILE *pipe, int pid )
+{
+#if defined( _WIN32 )
+	return _pclose( pipe );
+#else
+	fclose( pipe );
+	int status = 0;
+	while ( waitpid( pid, &status, 0 ) < 0 ) {
+		if ( errno != EINTR ) return -1;
+	}
+	return status;
+#endif
+}
+
+// -----------------------------------------------------------------
+void killProcess( int pid )
+{
+#if !defined( _WIN32 )
+	if ( pid > 0 ) kill( pid, SIGKILL );
+#endif
+}
+
+// -----------------------------------------------------------------
+size_t writeProcess( FILE *pipe, const unsigned char *data, size_t size, float timeout, bool &isStalled )
+{
+	isStalled = false;
+#if defined( _WIN32 )
+	return fwrite( data, sizeof( char ), size, pipe );  // anonymous pipes block, there's no timeout
+#else
+	const int fd   = fileno( pipe );
+	size_t written = 0;
+
+	while ( written < size ) {
+		const ssize_t n = write( fd, data + written, size - written );
+		if ( n > 0 ) {
+			written += n;
+			continue;
+		}
+		if ( n < 0 && errno == EINTR ) continue;
+		if ( n < 0 && errno != EAGAIN ) break;  // EPIPE - the process is gone
+
+		// the pipe is full, wait for the process to read
+		pollfd pfd = { fd, POLLOUT, 0 };
+		if ( poll( &pfd, 1, timeout < 0.f ? -1 : int( timeout * 1000 ) ) == 0 ) {
+			isStalled = true;
+			break;
+		}
+	}
+
+	return written;
+#endif
+}
+
+// -----------------------------------------------------------------
+size_t readProcess( FILE *pipe, unsigned char *data, size_t size )
+{
+#if defined( _WIN32 )
+	return fread( data, sizeof( char ), size, pipe );
+#else
+	// straight from the fd into data, stdio buffering would add a copy
+	const int fd = fileno( pipe );
+	size_t nRead = 0;
+
+	while ( nRead < size ) {
+		const ssize_t n = read( fd, data + nRead, size - nRead );
+		if ( n > 0 ) {
+			nRead += n;
+			continue;
+		}
+		if ( n < 0 && errno == EINTR ) continue;
+		break;  // end of stream
+	}
+
+	return nRead;
+#endif
+}
+
+// -----------------------------------------------------------------
+std::string getProcessOutput( const std::string &cmd, std::atomic<int> *pid )
+{
+	int processPid = -1;
+	FILE *pipe     = openProcess( cmd, processPid, ProcessPipe::Stdout );
+	if ( !pipe ) return "";
+	if ( pid ) pid->store( processPid );
+
+	std::string output;
+	unsigned char buffer[4096];
+	while ( const size_t n = readProcess( pipe, buffer, sizeof( buffer ) ) ) {
+		output.append( reinterpret_cast<const char *>( buffer ), n );
+		if ( n < sizeof( buffer ) ) break;
+	}
+
+	if ( pid ) pid->store( -1 );
+	return closeProcess( pipe, processPid ) == 0 ? output : "";
+}
+
+// -----------------------------------------------------------------
+std::string quoteArg( const std::string &arg )
+{
+#if defined( _WIN32 )
+	return "\"" + arg + "\"";  // windows paths can't contain quotes
+#else
+	// nothing is expanded between single quotes, a single quote itself has to close them, be escaped and reopen them
+	std::string quoted = "'";
+	for ( const char c : arg ) {
+		if ( c == '\'' ) quoted += "'\\''";
+		else quoted += c;
+	}
+	return quoted + "'";
+#endif
+}
+
+// -----------------------------------------------------------------
+std::string joinArgs( const std::string &cmd, const std::vector<std::string> &args )
+{
+	std::string joined = cmd;
+	for ( const auto &arg : args ) {
+		if ( !arg.empty() ) joined += " " + arg;
+	}
+	return joined;
+}
+
+// -----------------------------------------------------------------
+std::string getPixelFormatName( ofPixelFormat pixelFormat )
+{
+	switch ( pixelFormat ) {
+		case OF_PIXELS_RGB: return "rgb24";
+		case OF_PIXELS_RGBA: return "rgba";
+		case OF_PIXELS_GRAY: return "gray";
+		default: return "";
+	}
+}
+
+// -----------------------------------------------------------------
+std::string getDecoderCommand( const std::string &ffmpegPath, const DecoderArgs &decoder )
+{
+	// without accurate seeking the first frame is the keyframe itself, which the keyframe index and thumbnails rely on
+	std::string seek;
+	if ( decoder.seekTime > 0. ) {
+		seek = ( decoder.isAccurateSeek ? "-ss " : "-noaccurate_seek -ss " ) + std::to_string( decoder.seekTime );
+	}
+	const std::string pixelFormat = getPixelFormatName( decoder.pixelFormat == OF_PIXELS_RGBA ? OF_PIXELS_RGBA : OF_PIXELS_RGB );
+	const std::string frames      = decoder.nFrames > 0 ? "-frames:v " + std::to_string( decoder.nFrames ) : "";
+	const std::string filter      = decoder.filter.empty() ? "" : "-vf " + decoder.filter;
+
+	const std::vector<std::string> args = {
+	    "-v error",                        // only errors on stderr
+	    "-nostdin",                        // stdin isn't a terminal
+	    "-noautorotate",                   // frames keep the probed size
+	    decoder.inputArgs,                 // custom input args
+	    seek,                              // input seek
+	    "-i " + quoteArg( decoder.path ),  // input file
+	    "-map 0:v:0",                      // first video stream only
+	    frames,                            // stop after nFrames
+	    filter,                            // crop, scale...
+	    "-f rawvideo",                     // output codec
+	    "-pix_fmt " + pixelFormat,         // output pixel format
+	    decoder.outputArgs,                // custom output args
+	    "pipe:1"                           // output to stdout
+	};
+
+	return joinArgs( ffmpegPath.empty() ? "ffmpeg" : ffmpegPath, args );
+}
+
+}  // namespace ofxFFmpeg
@@ -0,0 +1,45 @@
+#pragma once
+#include "ofxFFmpegHelpers.h"
+
+namespace ofxFFmpeg {
+
+enum class ProcessPipe
+{
+	Stdin,  // frames are written to the process - encoders
+	Stdout  // the process' output is read back - decoders and probes
+};
+
+// starts cmd with a pipe to its stdin or from its stdout - unlike popen() this keeps the pid, so a stalled process can be killed
+FILE* openProcess( const std::string& cmd, int& pid, ProcessPipe direction = ProcessPipe::Stdin );
+int closeProcess( FILE* pipe, int pid );  // closes the pipe and waits for the process to exit, returns its status like pclose()
+void killProcess( int pid );
+
+// writes data unless the process consumes nothing for timeout seconds (< 0 waits forever) or has exited
+// returns the bytes written, isStalled tells a timeout from a dead process
+size_t writeProcess( FILE* pipe, const unsigned char* data, size_t size, float timeout, bool& isStalled );
+// blocks until size bytes are read or the process has closed its stdout, returns the bytes read
+size_t readProcess( FILE* pipe, unsigned char* data, size_t size );
+
+// runs cmd to completion and returns what it printed to stdout, empty if it failed
+// the pid is stored in pid while it runs, so another thread can kill it to cancel
+std::string getProcessOutput( const std::string& cmd, std::atomic<int>* pid = nullptr );
+
+std::string quoteArg( const std::string& arg );                                         // one literal argument for the shell, e.g. a path
+std::string joinArgs( const std::string& cmd, const std::vector<std::string>& args );  // cmd followed by the non-empty args
+std::string getPixelFormatName( ofPixelFormat pixelFormat );                           // ffmpeg's rgb24, rgba or gray - empty for anything else
+
+// a decoder for the first video stream of a file, writing raw frames to stdout for readProcess()
+struct DecoderArgs
+{
+	std::string path;
+	double seekTime           = 0.;             // seconds, from the start if <= 0
+	bool isAccurateSeek       = true;           // false starts at the keyframe before seekTime rather than decoding up to it
+	int nFrames               = 0;              // 0 decodes to the end
+	std::string filter        = "";             // -vf filter graph, e.g. crop or scale
+	ofPixelFormat pixelFormat = OF_PIXELS_RGB;  // OF_PIXELS_RGB or OF_PIXELS_RGBA
+	std::string inputArgs     = "";             // before the input, e.g. -skip_frame nokey
+	std::string outputArgs    = "";             // after the output format
+};
+std::string getDecoderCommand( const std::string& ffmpegPath, const DecoderArgs& decoder );
+
+}  // namespace ofxFFmpeg
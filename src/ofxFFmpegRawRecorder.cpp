@@ -0,0 +1,477 @@
+#include "ofxFFmpegRawRecorder.h"
+#include "ofxFFmpegProcess.h"
+// openFrameworks
+#include "ofLog.h"
+#include "ofUtils.h"
+
+#include <csignal>
+#include <fstream>
+
+#if defined( _WIN32 )
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Logging macros
+#define LOG_ERROR() ofLogError( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+#define LOG_WARNING() ofLogWarning( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+#define LOG_VERBOSE() ofLogVerbose( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+
+namespace ofxFFmpeg {
+
+// -----------------------------------------------------------------
+// Uncached writes need the memory, the file offset and the size aligned - to the page size, which covers the sector size
+// of any disk. Each platform has its own way to bypass the page cache and to reserve space for a file.
+namespace {
+
+	const int SidecarVersion = 1;
+
+	size_t getPageSize()
+	{
+#if defined( _WIN32 )
+		SYSTEM_INFO info;
+		GetSystemInfo( &info );
+		return size_t( info.dwPageSize );
+#else
+		return size_t( sysconf( _SC_PAGESIZE ) );
+#endif
+	}
+
+	unsigned char *allocateAligned( size_t size, size_t alignment )
+	{
+#if defined( _WIN32 )
+		return static_cast<unsigned char *>( _aligned_malloc( size, alignment ) );
+#else
+		void *data = nullptr;
+		return posix_memalign( &data, alignment, size ) == 0 ? static_cast<unsigned char *>( data ) : nullptr;
+#endif
+	}
+
+	void freeAligned( unsigned char *data )
+	{
+#if defined( _WIN32 )
+		_aligned_free( data );
+#else
+		free( data );
+#endif
+	}
+
+	// falls back to a cached file where the file system doesn't support uncached writes, like tmpfs
+	intptr_t openCaptureFile( const std::string &path, bool useDirectIO, bool &isDirectIO )
+	{
+#if defined( _WIN32 )
+		const DWORD flags = useDirectIO ? FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH : FILE_ATTRIBUTE_NORMAL;
+		HANDLE h          = CreateFileA( path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, flags, nullptr );
+		if ( h == INVALID_HANDLE_VALUE && useDirectIO ) {
+			h = CreateFileA( path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr );
+			useDirectIO = false;
+		}
+		isDirectIO = useDirectIO && h != INVALID_HANDLE_VALUE;
+		return h == INVALID_HANDLE_VALUE ? -1 : reinterpret_cast<intptr_t>( h );
+#else
+		int fd = -1;
+#if defined( O_DIRECT )
+		if ( useDirectIO ) fd = open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644 );
+		isDirectIO = fd >= 0;
+#endif
+		if ( fd < 0 ) fd = open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+#if defined( F_NOCACHE )
+		isDirectIO = useDirectIO && fd >= 0 && fcntl( fd, F_NOCACHE, 1 ) == 0;
+#endif
+		return fd;
+#endif
+	}
+
+	// reserves the blocks without changing the file's size, so a capture cut short by a crash ends at its last write
+	bool preallocateCaptureFile( intptr_t file, uint64_t size )
+	{
+		if ( size == 0 ) return true;
+#if defined( _WIN32 )
+		FILE_ALLOCATION_INFO info;
+		info.AllocationSize.QuadPart = LONGLONG( size );
+		return SetFileInformationByHandle( reinterpret_cast<HANDLE>( file ), FileAllocationInfo, &info, sizeof( info ) ) != 0;
+#elif defined( __APPLE__ )
+		fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, off_t( size ), 0 };
+		if ( fcntl( int( file ), F_PREALLOCATE, &store ) == 0 ) return true;
+		store.fst_flags = F_ALLOCATEALL;  // not contiguous then
+		return fcntl( int( file ), F_PREALLOCATE, &store ) == 0;
+#elif defined( FALLOC_FL_KEEP_SIZE )
+		return fallocate( int( file ), FALLOC_FL_KEEP_SIZE, 0, off_t( size ) ) == 0;
+#else
+		return false;
+#endif
+	}
+
+	bool writeCaptureFile( intptr_t file, const unsigned char *data, size_t size, uint64_t offset )
+	{
+		while ( size > 0 ) {
+#if defined( _WIN32 )
+			OVERLAPPED position = {};
+			position.Offset     = DWORD( offset );
+			position.OffsetHigh = DWORD( offset >> 32 );
+			DWORD written       = 0;
+			if ( !WriteFile( reinterpret_cast<HANDLE>( file ), data, DWORD( size ), &written, &position ) ) return false;
+#else
+			const ssize_t written = pwrite( int( file ), data, size, off_t( offset ) );
+			if ( written < 0 ) {
+				if ( errno == EINTR ) continue;
+				return false;
+			}
+#endif
+			if ( written == 0 ) return false;  // out of space
+			data += written;
+			size -= written;
+			offset += written;
+		}
+		return true;
+	}
+
+	// size drops the padding of the last write, and any space reserved past it
+	bool closeCaptureFile( intptr_t file, uint64_t size )
+	{
+#if defined( _WIN32 )
+		HANDLE h         = reinterpret_cast<HANDLE>( file );
+		LARGE_INTEGER end;
+		end.QuadPart     = LONGLONG( size );
+		const bool isSet = SetFilePointerEx( h, end, nullptr, FILE_BEGIN ) && SetEndOfFile( h );
+		return CloseHandle( h ) && isSet;
+#else
+		const bool isSet = ftruncate( int( file ), off_t( size ) ) == 0;
+		return close( int( file ) ) == 0 && isSet;
+#endif
+	}
+}  // namespace
+
+// -----------------------------------------------------------------
+RawRecorder::~RawRecorder()
+{
+	stop();
+}
+
+// -----------------------------------------------------------------
+bool RawRecorder::start( const RawRecorderSettings &settings )
+{
+	if ( m_isRecording || m_thread.joinable() ) {
+		LOG_WARNING() << "Already recording, stop() first";
+		return false;
+	}
+
+	const std::string pixelFormat = getPixelFormatName( settings.pixelFormat );
+	if ( pixelFormat.empty() || settings.videoResolution.x <= 0 || settings.videoResolution.y <= 0 || settings.fps <= 0.f ) {
+		LOG_ERROR() << "Unsupported settings - captures need a resolution, a frame rate and RGB, RGBA or GRAY pixels";
+		return false;
+	}
+
+	m_settings            = settings;
+	m_settings.outputPath = ofToDataPath( settings.outputPath, true );
+	if ( ofFile::doesFileExist( m_settings.outputPath, false ) && !m_settings.allowOverwrite ) {
+		LOG_ERROR() << "The file " << m_settings.outputPath << " already exists";
+		return false;
+	}
+
+	// blocks are a whole number of pages, and the pool holds at least two, so one can be filled while the other is written
+	const size_t channels = settings.pixelFormat == OF_PIXELS_RGBA ? 4 : settings.pixelFormat == OF_PIXELS_GRAY ? 1 : 3;
+	m_frameSize           = size_t( settings.videoResolution.x ) * settings.videoResolution.y * channels;
+	m_alignment           = getPageSize();
+	m_blockSize           = std::max<size_t>( 1, ( settings.writeSize + m_alignment - 1 ) / m_alignment ) * m_alignment;
+	m_nBlocks             = std::max<size_t>( 2, size_t( std::ceil( settings.bufferDuration * settings.fps * m_frameSize / m_blockSize ) ) + 1 );
+
+	m_pool = allocateAligned( m_nBlocks * m_blockSize, m_alignment );
+	if ( !m_pool ) {
+		LOG_ERROR() << "Unable to allocate " << m_nBlocks * m_blockSize / ( 1 << 20 ) << " MB for the capture pool";
+		return false;
+	}
+
+	m_file = openCaptureFile( m_settings.outputPath, settings.directIO, m_isDirectIO );
+	if ( m_file == -1 ) {
+		LOG_ERROR() << "Unable to open " << m_settings.outputPath;
+		releasePool();
+		return false;
+	}
+
+	const uint64_t nReserved = uint64_t( std::max( 0.f, settings.preallocateDuration * settings.fps ) );
+	if ( !preallocateCaptureFile( m_file, nReserved * m_frameSize ) ) {
+		LOG_VERBOSE() << "Unable to reserve space for " << m_settings.outputPath << ", the file grows as it's written";
+	}
+
+	// the writer drains the ring before each block, by then the pool's frames are at most all that's queued
+	m_pendingTimestamps.allocate( m_nBlocks * m_blockSize / m_frameSize + 2 );
+	m_timestamps.clear();
+	m_timestamps.reserve( nReserved );
+	m_blockOffset    = 0;
+	m_nFilledBlocks  = 0;
+	m_nWrittenBlocks = 0;
+	m_nAddedFrames   = 0;
+	m_nDroppedFrames = 0;
+	m_bytesWritten   = 0;
+	m_hasFailed      = false;
+	m_writeLatency.reset();
+
+	// written again by stop(), a capture cut short can still be encoded
+	saveSidecar();
+
+	m_startTime   = Clock::now();
+	m_isRecording = true;
+	m_thread      = std::thread( &RawRecorder::processWriter, this );
+
+	LOG_VERBOSE() << "Capturing to " << m_settings.outputPath << ( m_isDirectIO ? " (direct io), " : ", " ) << m_nBlocks << " blocks of " << m_blockSize << " bytes";
+	return true;
+}
+
+// -----------------------------------------------------------------
+void RawRecorder::stop()
+{
+	if ( !m_thread.joinable() ) return;
+
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_isRecording = false;
+		m_condition.notify_all();
+	}
+	m_thread.join();  // the writer finishes the filled blocks first
+	drainTimestamps();
+
+	// the partly filled block goes out padded to the alignment, closing the file trims the padding
+	const uint64_t size = m_nWrittenBlocks * m_blockSize + ( m_hasFailed ? 0 : m_blockOffset );
+	if ( m_blockOffset > 0 && !m_hasFailed ) {
+		const size_t padded = ( m_blockOffset + m_alignment - 1 ) / m_alignment * m_alignment;
+		if ( writeCaptureFile( m_file, m_pool + ( m_nFilledBlocks % m_nBlocks ) * m_blockSize, padded, m_nWrittenBlocks * m_blockSize ) ) {
+			m_bytesWritten += m_blockOffset;
+		} else {
+			LOG_ERROR() << "Unable to write the last frames to " << m_settings.outputPath;
+		}
+	}
+
+	if ( !closeCaptureFile( m_file, size ) ) {
+		LOG_WARNING() << "Unable to trim " << m_settings.outputPath << " to " << size << " bytes";
+	}
+	m_file = -1;
+	releasePool();
+
+	if ( !saveSidecar() ) {
+		LOG_ERROR() << "Unable to save " << getSidecarPath( m_settings.outputPath );
+	}
+	LOG_VERBOSE() << "Captured " << m_nAddedFrames << " frames, dropped " << m_nDroppedFrames;
+}
+
+// -----------------------------------------------------------------
+size_t RawRecorder::addFrame( const ofPixels &pixels )
+{
+	if ( !m_isRecording ) {
+		LOG_ERROR() << "Can't add new frame - not in recording mode.";
+		return 0;
+	}
+
+	if ( pixels.getTotalBytes() != m_frameSize || pixels.getWidth() != size_t( m_settings.videoResolution.x ) ) {
+		LOG_ERROR() << "Can't add new frame - pixels don't match the capture's resolution and format";
+		return 0;
+	}
+
+	// the block the frame ends in has to be free, or the writer isn't keeping up
+	const uint64_t lastBlock = m_nFilledBlocks + ( m_blockOffset + m_frameSize ) / m_blockSize;
+	if ( lastBlock - m_nWrittenBlocks >= m_nBlocks ) {
+		++m_nDroppedFrames;
+		return 0;
+	}
+
+	// frames run on across blocks, the file is one stream of them
+	const unsigned char *data = pixels.getData();
+	size_t remaining          = m_frameSize;
+	while ( remaining > 0 ) {
+		unsigned char *block = m_pool + ( m_nFilledBlocks % m_nBlocks ) * m_blockSize;
+		const size_t size    = std::min( remaining, m_blockSize - m_blockOffset );
+		std::memcpy( block + m_blockOffset, data, size );
+		data += size;
+		remaining -= size;
+		m_blockOffset += size;
+
+		if ( m_blockOffset == m_blockSize ) {
+			std::lock_guard<std::mutex> lock( m_mutex );
+			m_blockOffset = 0;
+			++m_nFilledBlocks;
+			m_condition.notify_one();
+		}
+	}
+
+	const float time = Seconds( Clock::now() - m_startTime ).count();
+	m_pendingTimestamps.write( &time, 1 );
+	++m_nAddedFrames;
+	return 1;
+}
+
+// -----------------------------------------------------------------
+RawRecorderStats RawRecorder::getStats() const
+{
+	RawRecorderStats stats;
+	stats.framesAdded     = m_nAddedFrames.load();
+	stats.framesDropped   = m_nDroppedFrames.load();
+	stats.bytesWritten    = m_bytesWritten.load();
+	stats.bufferedBytes   = size_t( m_nFilledBlocks - m_nWrittenBlocks ) * m_blockSize;
+	stats.writeLatencyP50 = m_writeLatency.getPercentile( 0.5f ).count();
+	stats.writeLatencyP99 = m_writeLatency.getPercentile( 0.99f ).count();
+	stats.writeLatencyMax = m_writeLatency.getMax().count();
+	stats.isDirectIO      = m_isDirectIO;
+
+	const float elapsed  = Seconds( Clock::now() - m_startTime ).count();
+	stats.bytesPerSecond = m_isRecording && elapsed > 0.f ? stats.bytesWritten / elapsed : 0.;
+	return stats;
+}
+
+// -----------------------------------------------------------------
+std::string RawRecorder::getSidecarPath( const std::string &outputPath )
+{
+	return outputPath + ".json";
+}
+
+// -----------------------------------------------------------------
+bool RawRecorder::saveSidecar() const
+{
+	const ofJson json = {
+	    { "version", SidecarVersion },
+	    { "width", m_settings.videoResolution.x },
+	    { "height", m_settings.videoResolution.y },
+	    { "pixelFormat", getPixelFormatName( m_settings.pixelFormat ) },
+	    { "fps", m_settings.fps },
+	    { "frameSize", m_frameSize },
+	    { "frames", m_nAddedFrames.load() },
+	    { "dropped", m_nDroppedFrames.load() },
+	    { "timestamps", m_timestamps },
+	};
+	return ofSaveJson( getSidecarPath( m_settings.outputPath ), json );
+}
+
+// -----------------------------------------------------------------
+void RawRecorder::releasePool()
+{
+	if ( m_pool ) freeAligned( m_pool );
+	m_pool = nullptr;
+}
+
+// -----------------------------------------------------------------
+void RawRecorder::drainTimestamps()
+{
+	float times[256];
+	while ( const size_t n = m_pendingTimestamps.read( times, 256 ) ) {
+		m_timestamps.insert( m_timestamps.end(), times, times + n );
+	}
+}
+
+// -----------------------------------------------------------------
+void RawRecorder::processWriter()
+{
+	std::unique_lock<std::mutex> lock( m_mutex );
+	while ( true ) {
+		m_condition.wait( lock, [this] { return m_nWrittenBlocks < m_nFilledBlocks || !m_isRecording; } );
+		if ( m_nWrittenBlocks == m_nFilledBlocks ) break;  // stopped, and everything is written
+
+		// addFrame() doesn't touch filled blocks, so they're written without the lock
+		const uint64_t index = m_nWrittenBlocks;
+		lock.unlock();
+		drainTimestamps();
+
+		const TimePoint writeTime = Clock::now();
+		const bool isWritten      = writeCaptureFile( m_file, m_pool + ( index % m_nBlocks ) * m_blockSize, m_blockSize, index * m_blockSize );
+		m_writeLatency.add( Clock::now() - writeTime );
+
+		lock.lock();
+		if ( !isWritten ) {
+			LOG_ERROR() << "Unable to write to " << m_settings.outputPath << ", the capture ends here";
+			m_hasFailed   = true;
+			m_isRecording = false;
+			break;
+		}
+		m_bytesWritten += m_blockSize;
+		++m_nWrittenBlocks;
+	}
+}
+
+// -----------------------------------------------------------------
+bool encodeRawCapture( const std::string &rawPath, const RecorderSettings &settings )
+{
+	const std::string inputPath = ofToDataPath( rawPath, true );
+	const ofJson sidecar        = ofLoadJson( RawRecorder::getSidecarPath( inputPath ) );
+	if ( !sidecar.is_object() || sidecar.value( "version", 0 ) != SidecarVersion ) {
+		LOG_ERROR() << "No capture sidecar for " << inputPath;
+		return false;
+	}
+
+	const std::string outputPath = ofToDataPath( settings.outputPath, true );
+	if ( ofFile::doesFileExist( outputPath, false ) && !settings.allowOverwrite ) {
+		LOG_ERROR() << "The file " << outputPath << " already exists";
+		return false;
+	}
+
+	// frames are piped in at the capture rate, each held until the next one's timestamp - frames dropped by the capture
+	// would otherwise shorten the video and pull it out of sync
+	const float fps        = sidecar.value( "fps", 30.f );
+	const size_t frameSize = sidecar.value( "frameSize", size_t( 0 ) );
+	const auto timestamps  = sidecar.value( "timestamps", std::vector<float>() );
+	std::ifstream input( inputPath, std::ios::binary | std::ios::ate );
+	if ( !input || frameSize == 0 || fps <= 0.f ) {
+		LOG_ERROR() << "Unable to read the capture " << inputPath;
+		return false;
+	}
+	const size_t nFrames = size_t( input.tellg() ) / frameSize;
+	const bool isTimed   = timestamps.size() >= nFrames;  // a capture cut short only has the sidecar start() saved
+	input.seekg( 0 );
+	if ( !isTimed ) {
+		LOG_WARNING() << "No timestamps for " << inputPath << ", frames are encoded at " << fps << " fps as they are";
+	}
+
+	const std::vector<std::string> args = {
+	    "-y",                                                      // overwrite
+	    "-v error",                                                // only errors on stderr
+	    "-f rawvideo",                                             // input codec
+	    "-pix_fmt " + sidecar.value( "pixelFormat", "rgb24" ),     // input pixel format
+	    "-s " + std::to_string( sidecar.value( "width", 0 ) ) +    // input resolution x
+	        "x" + std::to_string( sidecar.value( "height", 0 ) ),  // input resolution y
+	    "-framerate " + ofToString( fps ),                         // input frame rate
+	    "-i pipe:0",                                               // input from stdin
+	    "-c:v " + settings.videoCodec,                             // output codec
+	    "-b:v " + ofToString( settings.bitrate ) + "k",            // output bitrate kbps (hint)
+	    settings.extraOutputArgs,                                  // custom output args
+	    quoteArg( outputPath )                                     // output path
+	};
+
+	const std::string cmd = joinArgs( settings.ffmpegPath.empty() ? "ffmpeg" : settings.ffmpegPath, args );
+	LOG_VERBOSE() << "Starting ffmpeg with command...\n\t" << cmd << "\n";
+
+#if !defined( _WIN32 )
+	signal( SIGPIPE, SIG_IGN );  // a failing ffmpeg has to fail writes with EPIPE rather than terminate the app
+#endif
+
+	int pid    = -1;
+	FILE *pipe = openProcess( cmd, pid, ProcessPipe::Stdin );
+	if ( !pipe ) {
+		LOG_ERROR() << "Unable to start ffmpeg for " << inputPath;
+		return false;
+	}
+
+	// the frame on slot n of the output is the last one captured before n / fps
+	const auto getSlot = [&]( size_t frame ) { return isTimed ? int64_t( std::round( ( timestamps[frame] - timestamps[0] ) * fps ) ) : int64_t( frame ); };
+
+	std::vector<unsigned char> frame( frameSize );
+	int64_t nWritten = 0;
+	bool isWritten   = true;
+	for ( size_t i = 0; i < nFrames && isWritten; ++i ) {
+		if ( !input.read( reinterpret_cast<char *>( frame.data() ), frameSize ) ) break;
+
+		bool isStalled    = false;
+		const int64_t end = i + 1 < nFrames ? getSlot( i + 1 ) : nWritten + 1;
+		for ( ; nWritten < end && isWritten; ++nWritten ) {
+			isWritten = writeProcess( pipe, frame.data(), frameSize, -1.f, isStalled ) == frameSize;
+		}
+	}
+
+	if ( closeProcess( pipe, pid ) != 0 || !isWritten ) {
+		LOG_ERROR() << "ffmpeg failed to encode " << inputPath;
+		return false;
+	}
+	LOG_VERBOSE() << "Encoded " << nFrames << " captured frames as " << nWritten;
+	return true;
+}
+
+}  // namespace ofxFFmpeg
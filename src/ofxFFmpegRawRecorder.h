@@ -0,0 +1,92 @@
+#pragma once
+#include "ofxFFmpegRecorderSettings.h"
+
+namespace ofxFFmpeg {
+
+struct RawRecorderSettings
+{
+	std::string outputPath     = "capture.raw";  // frames back to back, described by outputPath.json
+	glm::ivec2 videoResolution = { 640, 480 };
+	ofPixelFormat pixelFormat  = OF_PIXELS_RGB;  // OF_PIXELS_RGB, OF_PIXELS_RGBA or OF_PIXELS_GRAY
+	float fps                  = 30.f;           // the capture rate, for encodeRawCapture()
+	float bufferDuration       = 1.f;            // seconds of frames pooled in memory for the writer, allocated by start()
+	float preallocateDuration  = 60.f;           // seconds of frames reserved on disk by start(), the file can grow past it
+	size_t writeSize           = 8 << 20;        // bytes per write, rounded up to the page size
+	bool directIO              = true;           // bypass the page cache - O_DIRECT, F_NOCACHE on macos, FILE_FLAG_NO_BUFFERING on windows
+	bool allowOverwrite        = true;
+};
+
+struct RawRecorderStats
+{
+	uint64_t framesAdded   = 0;
+	uint64_t framesDropped = 0;  // the pool was full, because the disk is slower than the capture
+	uint64_t bytesWritten  = 0;
+	double bytesPerSecond  = 0.;   // average write throughput since start()
+	size_t bufferedBytes   = 0;    // filled and waiting for the writer
+	float writeLatencyP50  = 0.f;  // seconds per writeSize write
+	float writeLatencyP99  = 0.f;
+	float writeLatencyMax  = 0.f;
+	bool isDirectIO        = false;  // the file bypasses the page cache
+};
+
+/**
+ * RawRecorder captures frames to disk without encoding them, for bursts no encoder could keep up with. start()
+ * allocates a page aligned pool of writeSize blocks and reserves the file. addFrame() copies each frame into the pool,
+ * back to back across blocks, and a writer thread writes every filled block with one aligned write. Nothing is
+ * allocated per frame. The capture is described by a JSON sidecar with the frame geometry and each frame's time, and
+ * encodeRawCapture() turns it into a regular file afterwards.
+ */
+class RawRecorder
+{
+public:
+	~RawRecorder();
+
+	bool start( const RawRecorderSettings& settings );
+	void stop();  // writes the rest of the pool, trims the file and saves the sidecar - call from the thread that calls addFrame()
+
+	size_t addFrame( const ofPixels& pixels );  // returns the number of frames added, 0 if it was dropped
+
+	bool isRecording() const { return m_isRecording.load(); }
+	float getRecordedDuration() const { return m_nAddedFrames / m_settings.fps; }
+	const RawRecorderSettings& getSettings() const { return m_settings; }
+	RawRecorderStats getStats() const;  // cheap snapshot, safe to call from any thread
+
+	static std::string getSidecarPath( const std::string& outputPath );  // capture.raw.json
+
+protected:
+	RawRecorderSettings m_settings;
+	std::atomic<bool> m_isRecording { false };
+	std::atomic<bool> m_hasFailed { false };  // a write failed, the capture ended there
+	intptr_t m_file = -1;                     // fd on posix, HANDLE on windows
+	bool m_isDirectIO = false;
+	size_t m_frameSize = 0, m_alignment = 0;
+	TimePoint m_startTime;
+
+	// the pool, used as a ring of blocks - addFrame() fills block m_nFilledBlocks, the writer writes m_nWrittenBlocks
+	unsigned char* m_pool = nullptr;
+	size_t m_blockSize = 0, m_nBlocks = 0;
+	size_t m_blockOffset = 0;  // bytes filled in the current block
+	std::atomic<uint64_t> m_nFilledBlocks { 0 }, m_nWrittenBlocks { 0 };
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::thread m_thread;
+
+	// seconds since start() of every frame - addFrame() queues them in a ring sized for the frames the pool holds, and the
+	// writer moves them to m_timestamps, so the capture thread never grows a vector
+	RingBuffer<float> m_pendingTimestamps;
+	std::vector<float> m_timestamps;  // reserved for preallocateDuration
+	std::atomic<uint64_t> m_nAddedFrames { 0 }, m_nDroppedFrames { 0 }, m_bytesWritten { 0 };
+	LatencyHistogram m_writeLatency;
+
+	bool saveSidecar() const;
+	void releasePool();
+	void drainTimestamps();  // on the writer thread, or after it's joined
+	void processWriter();
+};
+
+// encodes a RawRecorder capture with ffmpeg, blocking until it's done - the resolution, pixel format and frame rate come
+// from the capture's sidecar, the output path, codec, bitrate and extra output args from settings. Frames are placed by
+// their timestamps, a frame before a gap is repeated over it
+bool encodeRawCapture( const std::string& rawPath, const RecorderSettings& settings );
+
+}  // namespace ofxFFmpeg
@@ -0,0 +1,67 @@
+#pragma once
+#include "ofxFFmpegHelpers.h"
+
+namespace ofxFFmpeg {
+
+enum class AudioDriftCorrection
+{
+	None,        // write samples as delivered by the sound card
+	Resample,    // stretch audio to the recording clock with a fractional resampler in the audio writer
+	FFmpegAsync  // timestamp audio with the wall clock and let ffmpeg's aresample=async fill/trim samples
+};
+
+enum class StallAction
+{
+	Restart,  // kill ffmpeg and continue in a new process and file, like restartOnFailure
+	Drop,     // keep waiting, discarding queued frames so memory doesn't grow
+	Callback  // keep waiting, only call onStall
+};
+
+struct RecorderSettings
+{
+	std::string outputPath      = "output.mp4";
+	glm::ivec2 videoResolution  = { 640, 480 };
+	float fps                   = 30.f;
+	unsigned int bitrate        = 20000;  // kbps
+	std::string videoCodec      = "libx264";
+	std::string extraInputArgs  = "";
+	std::string extraOutputArgs = "-pix_fmt yuv420p -vsync 1 -g 1";  // -crf 0 -preset ultrafast -tune zerolatency setpts='(RTCTIME - RTCSTART) / (TB * 1000000)'
+	bool allowOverwrite         = true;
+	std::string ffmpegPath      = "ffmpeg";
+
+	// audio
+	bool recordAudio             = false;  // feed audio with Recorder::addAudio()
+	unsigned int audioSampleRate = 44100;
+	unsigned int audioChannels   = 2;
+	unsigned int audioBitrate    = 192;  // kbps
+	std::string audioCodec       = "aac";
+	float audioBufferDuration    = 2.f;  // seconds of audio buffered between the sound callback and the audio writer
+	AudioDriftCorrection audioDriftCorrection = AudioDriftCorrection::Resample;  // keeps the sound card clock in sync with the video frame clock
+
+	// segments - split a long recording into consecutive files, without losing or repeating a frame at the cut
+	// files are named outputPath with a _000 style index, or outputPath is used as a pattern if it has one %d or %0Nd and only %% otherwise ( "rec_%04d.mp4" )
+	float segmentDuration = 0.f;  // seconds per file, 0 = don't split by duration
+	uint64_t segmentSize  = 0;    // bytes per file (as ffmpeg has written them so far), 0 = don't split by size
+
+	// resilience - if ffmpeg dies, respawn it into a continuation file (named like segments) and carry on with the queued
+	// frames, listing all files in an ffconcat manifest next to the first one. mp4/mov output is fragmented every second,
+	// so a file cut short by a crash stays playable
+	bool restartOnFailure    = false;
+	unsigned int maxRestarts = 3;  // consecutive restarts that didn't get a frame through before giving up
+
+	// watchdog - a stall is ffmpeg not reading anything for stallTimeout seconds while frames queue up, e.g. when its disk
+	// is full or hung. A stall during stop() kills ffmpeg, so stop() always finishes. Needs posix, windows pipes block
+	float stallTimeout            = 0.f;  // 0 = wait forever
+	StallAction stallAction       = StallAction::Restart;
+	std::function<void()> onStall = nullptr;  // called from the writer thread on every stall, whatever the action
+
+	// pre-roll - see Recorder::startPreRoll()
+	float preRollDuration             = 0.f;    // seconds of frames kept in memory
+	bool preRollCompression           = false;  // keep pre-roll frames as jpeg - a fraction of the memory, for encoding time in addFrame()
+	ofImageQualityType preRollQuality = OF_IMAGE_QUALITY_HIGH;
+
+	// replay buffer - see Recorder::startReplayBuffer()
+	float replayDuration = 0.f;  // seconds of encoded stream kept in memory
+};
+
+}  // namespace ofxFFmpeg
@@ -0,0 +1,254 @@
+#include "ofxFFmpegReverseDecoder.h"
+#include "ofxFFmpegProcess.h"
+// openFrameworks
+#include "ofLog.h"
+
+// Logging macros
+#define LOG_ERROR() ofLogError( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+#define LOG_VERBOSE() ofLogVerbose( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+
+namespace ofxFFmpeg {
+
+// -----------------------------------------------------------------
+ReverseDecoder::~ReverseDecoder()
+{
+	stop();
+}
+
+// -----------------------------------------------------------------
+void ReverseDecoder::start( const ReverseDecoderSettings &settings, int frame, bool isLooping )
+{
+	stop();
+
+	m_settings             = settings;
+	m_settings.chunkFrames = std::max( 1, m_settings.chunkFrames );
+	m_settings.chunks      = std::max<size_t>( 1, m_settings.chunks );
+	m_playhead             = std::max( 0, std::min( frame, m_settings.numFrames - 1 ) );
+	m_isLooping            = isLooping;
+	m_nChunksDecoded       = 0;
+	m_nChunksDropped       = 0;
+	m_nFramesDecoded       = 0;
+
+	m_isRunning = true;
+	for ( size_t i = 0; i < std::max<size_t>( 1, m_settings.threads ); ++i ) {
+		m_threads.emplace_back( &ReverseDecoder::process, this );
+	}
+}
+
+// -----------------------------------------------------------------
+void ReverseDecoder::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_isRunning = false;
+		for ( const auto &chunk : m_chunks ) {
+			killProcess( chunk.second->pid );
+		}
+		m_condition.notify_all();
+	}
+
+	for ( auto &thread : m_threads ) {
+		thread.join();
+	}
+	m_threads.clear();
+	m_chunks.clear();
+	m_spares.clear();
+}
+
+// -----------------------------------------------------------------
+void ReverseDecoder::setPlayhead( int frame, bool isLooping )
+{
+	frame = std::max( 0, std::min( frame, m_settings.numFrames - 1 ) );
+
+	std::lock_guard<std::mutex> lock( m_mutex );
+	if ( frame == m_playhead && isLooping == m_isLooping ) return;
+
+	m_playhead  = frame;
+	m_isLooping = isLooping;
+	dropChunks();
+	m_condition.notify_all();
+}
+
+// -----------------------------------------------------------------
+bool ReverseDecoder::takeFrame( int frame, ofPixels &pixels )
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	auto it = m_chunks.upper_bound( frame );
+	if ( it == m_chunks.begin() ) return false;
+	Chunk &chunk = *( --it )->second;
+
+	int i = frame - chunk.first;
+	if ( i >= chunk.nFrames ) return false;
+
+	// ffmpeg ended early, the frame count may have been estimated - the last frame stands in for the missing ones
+	if ( chunk.isDone && !chunk.frames.empty() ) i = std::min( i, int( chunk.frames.size() ) - 1 );
+	if ( i >= int( chunk.frames.size() ) ) return false;
+
+	// shown before and swapped out, e.g. stepped back to - the chunk is decoded again
+	if ( chunk.isTaken[i] ) {
+		dropChunk( it );
+		m_condition.notify_all();
+		return false;
+	}
+
+	pixels.swap( chunk.frames[i] );
+	chunk.isTaken[i] = true;
+	return true;
+}
+
+// -----------------------------------------------------------------
+ReverseDecoderStats ReverseDecoder::getStats() const
+{
+	ReverseDecoderStats stats;
+	stats.chunksDecoded = m_nChunksDecoded.load();
+	stats.chunksDropped = m_nChunksDropped.load();
+	stats.framesDecoded = m_nFramesDecoded.load();
+	return stats;
+}
+
+// -----------------------------------------------------------------
+void ReverseDecoder::getChunk( int frame, int &first, int &nFrames ) const
+{
+	const auto &index  = m_settings.index;
+	const int keyframe = index ? index->getKeyframeBefore( frame ) : 0;
+	const int next     = index ? index->getKeyframeAfter( frame ) : m_settings.numFrames;
+
+	first   = keyframe + ( frame - keyframe ) / m_settings.chunkFrames * m_settings.chunkFrames;
+	nFrames = std::min( first + m_settings.chunkFrames, std::max( next, frame + 1 ) ) - first;
+}
+
+// -----------------------------------------------------------------
+std::vector<int> ReverseDecoder::getWantedChunks() const
+{
+	std::vector<int> wanted;
+	int frame = m_playhead;
+	while ( wanted.size() < m_settings.chunks ) {
+		if ( frame < 0 ) {
+			if ( !m_isLooping ) break;
+			frame = m_settings.numFrames - 1;
+		}
+
+		int first = 0, nFrames = 0;
+		getChunk( frame, first, nFrames );
+		if ( std::find( wanted.begin(), wanted.end(), first ) != wanted.end() ) break;  // wrapped around a short file
+
+		wanted.push_back( first );
+		frame = first - 1;
+	}
+	return wanted;
+}
+
+// -----------------------------------------------------------------
+void ReverseDecoder::dropChunks()
+{
+	const std::vector<int> wanted = getWantedChunks();
+	for ( auto it = m_chunks.begin(); it != m_chunks.end(); ) {
+		if ( std::find( wanted.begin(), wanted.end(), it->first ) != wanted.end() ) {
+			++it;
+			continue;
+		}
+
+		it = dropChunk( it );
+	}
+}
+
+// -----------------------------------------------------------------
+ReverseDecoder::ChunkMap::iterator ReverseDecoder::dropChunk( ChunkMap::iterator it )
+{
+	Chunk &chunk = *it->second;
+	if ( !chunk.isDone ) ++m_nChunksDropped;
+	chunk.isDropped = true;
+	killProcess( chunk.pid );  // its worker moves on
+
+	for ( auto &pixels : chunk.frames ) {
+		if ( m_spares.size() >= size_t( m_settings.chunkFrames ) ) break;
+		m_spares.push_back( std::move( pixels ) );
+	}
+	chunk.frames.clear();
+	return m_chunks.erase( it );
+}
+
+// -----------------------------------------------------------------
+void ReverseDecoder::process()
+{
+	std::unique_lock<std::mutex> lock( m_mutex );
+	while ( m_isRunning ) {
+		// the wanted chunk nearest to the playhead that nobody has started on
+		std::shared_ptr<Chunk> chunk;
+		for ( int first : getWantedChunks() ) {
+			if ( m_chunks.count( first ) ) continue;
+
+			chunk = std::make_shared<Chunk>();
+			getChunk( first, chunk->first, chunk->nFrames );
+			chunk->frames.reserve( chunk->nFrames );
+			chunk->isTaken.assign( chunk->nFrames, false );
+			m_chunks[first] = chunk;
+			break;
+		}
+
+		if ( !chunk ) {
+			m_condition.wait( lock );
+			continue;
+		}
+
+		lock.unlock();
+		decode( *chunk );
+		lock.lock();
+	}
+}
+
+// -----------------------------------------------------------------
+void ReverseDecoder::decode( Chunk &chunk )
+{
+	const size_t frameSize = m_settings.width * m_settings.height * ( m_settings.pixelFormat == OF_PIXELS_RGBA ? 4 : 3 );
+
+	const std::string cmd = m_settings.command( chunk.first, chunk.nFrames );
+	LOG_VERBOSE() << "Decoding frames " << chunk.first << " to " << chunk.first + chunk.nFrames - 1 << " with command...\n\t" << cmd << "\n";
+
+	int pid    = -1;
+	FILE *pipe = openProcess( cmd, pid, ProcessPipe::Stdout );
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		if ( !pipe ) {
+			LOG_ERROR() << "Unable to start ffmpeg";
+			chunk.isDone = true;
+			return;
+		}
+		chunk.pid = pid;
+		if ( chunk.isDropped || !m_isRunning ) killProcess( pid );  // dropped or stopped meanwhile
+	}
+	++m_nChunksDecoded;
+
+	for ( int i = 0; i < chunk.nFrames; ++i ) {
+		ofPixels pixels;
+		{
+			std::lock_guard<std::mutex> lock( m_mutex );
+			if ( chunk.isDropped || !m_isRunning ) break;
+			if ( !m_spares.empty() ) {
+				pixels = std::move( m_spares.back() );
+				m_spares.pop_back();
+			}
+		}
+
+		if ( pixels.getTotalBytes() != frameSize ) {
+			pixels.allocate( m_settings.width, m_settings.height, m_settings.pixelFormat );
+		}
+		if ( readProcess( pipe, pixels.getData(), frameSize ) < frameSize ) break;
+		++m_nFramesDecoded;
+
+		std::lock_guard<std::mutex> lock( m_mutex );
+		if ( chunk.isDropped ) break;
+		chunk.frames.push_back( std::move( pixels ) );
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		chunk.isDone = true;
+		killProcess( chunk.pid );  // done, or its remaining frames aren't wanted
+		chunk.pid = -1;
+	}
+	closeProcess( pipe, pid );
+}
+
+}  // namespace ofxFFmpeg
@@ -0,0 +1,80 @@
+#pragma once
+#include "ofxFFmpegHelpers.h"
+#include "ofxFFmpegKeyframeIndex.h"
+
+#include <map>
+
+namespace ofxFFmpeg {
+
+struct ReverseDecoderSettings
+{
+	size_t width                               = 0;
+	size_t height                              = 0;
+	ofPixelFormat pixelFormat                  = OF_PIXELS_RGB;
+	int numFrames                              = 0;
+	std::shared_ptr<const KeyframeIndex> index = nullptr;  // chunks start at keyframes, otherwise every chunkFrames frames
+	std::function<std::string( int frame, int nFrames )> command;  // ffmpeg writing nFrames raw frames from frame to stdout
+	size_t threads  = 2;   // chunks decoded in parallel
+	size_t chunks   = 3;   // chunks held, including the one being shown
+	int chunkFrames = 30;  // longer GOPs are split, each part decodes from the keyframe again
+};
+
+struct ReverseDecoderStats
+{
+	uint64_t chunksDecoded = 0;  // ffmpeg processes started
+	uint64_t chunksDropped = 0;  // the playhead moved on before they were shown
+	uint64_t framesDecoded = 0;
+};
+
+/**
+ * ReverseDecoder decodes a file backwards, in GOP sized chunks of frames - a chunk can only be decoded forwards from its
+ * keyframe, so it's shown once all of it is decoded. Worker threads each run an ffmpeg on the next chunk behind the
+ * playhead, and chunks the playhead has passed are dropped, so at most chunks * chunkFrames frames are held.
+ */
+class ReverseDecoder
+{
+public:
+	~ReverseDecoder();
+
+	void start( const ReverseDecoderSettings& settings, int frame, bool isLooping );
+	void stop();
+	bool isRunning() const { return m_isRunning; }
+
+	void setPlayhead( int frame, bool isLooping );  // decodes from frame backwards, wrapping to the end when looping
+	bool takeFrame( int frame, ofPixels& pixels );  // swaps a decoded frame into pixels - false if it's not decoded yet
+
+	ReverseDecoderStats getStats() const;
+
+protected:
+	struct Chunk
+	{
+		int first = 0, nFrames = 0;
+		std::vector<ofPixels> frames;  // decoded so far
+		std::vector<bool> isTaken;
+		bool isDone    = false;
+		bool isDropped = false;
+		int pid        = -1;
+	};
+
+	using ChunkMap = std::map<int, std::shared_ptr<Chunk>>;  // by first frame
+
+	ReverseDecoderSettings m_settings;
+	std::vector<std::thread> m_threads;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::atomic<bool> m_isRunning { false };
+	int m_playhead   = 0;
+	bool m_isLooping = false;
+	ChunkMap m_chunks;
+	std::vector<ofPixels> m_spares;  // from dropped chunks, for the next ones
+	std::atomic<uint64_t> m_nChunksDecoded { 0 }, m_nChunksDropped { 0 }, m_nFramesDecoded { 0 };
+
+	void process();
+	void decode( Chunk& chunk );
+	void getChunk( int frame, int& first, int& nFrames ) const;  // the chunk frame belongs to
+	std::vector<int> getWantedChunks() const;                    // firsts, nearest to the playhead first
+	void dropChunks();  // the ones that aren't wanted anymore, needs the lock
+	ChunkMap::iterator dropChunk( ChunkMap::iterator it );  // needs the lock
+};
+
+}  // namespace ofxFFmpeg
@@ -0,0 +1,475 @@
+#include "ofxFFmpegSyncPlayer.h"
+#include "ofxFFmpegProcess.h"
+// openFrameworks
+#include "ofLog.h"
+#include "ofUtils.h"
+
+#if !defined( _WIN32 )
+#include <poll.h>
+#endif
+
+// Logging macros
+#define LOG_ERROR() ofLogError( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+#define LOG_WARNING() ofLogWarning( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+#define LOG_VERBOSE() ofLogVerbose( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+
+namespace ofxFFmpeg {
+
+namespace {
+
+	// until one of the pipes has a frame, or the end of its stream, to read - false after timeout seconds
+	bool waitForOutput( const std::vector<int> &fds, float timeout )
+	{
+#if defined( _WIN32 )
+		return true;  // anonymous pipes can't be polled, reads block instead
+#else
+		std::vector<pollfd> pfds;
+		for ( const int fd : fds ) {
+			pfds.push_back( { fd, POLLIN, 0 } );
+		}
+		return poll( pfds.data(), pfds.size(), int( timeout * 1000 ) ) > 0;
+#endif
+	}
+
+	bool hasOutput( FILE *pipe )
+	{
+		return waitForOutput( { fileno( pipe ) }, 0.f );
+	}
+}  // namespace
+
+// -----------------------------------------------------------------
+SyncPlayer::~SyncPlayer()
+{
+	close();
+}
+
+// -----------------------------------------------------------------
+void SyncPlayer::setup( const SyncPlayerSettings &settings )
+{
+	if ( isLoaded() ) {
+		LOG_WARNING() << "Settings take effect with the next load()";
+	}
+	m_settings = settings;
+}
+
+// -----------------------------------------------------------------
+bool SyncPlayer::load( const std::vector<std::string> &paths )
+{
+	close();
+
+	// every file is probed at once, a wall of clips would otherwise wait for each ffprobe in turn
+	std::vector<MediaInfo> infos;
+	if ( m_settings.probeCache ) {
+		infos = m_settings.probeCache->probe( paths );
+	} else {
+		std::vector<std::future<MediaInfo>> probes;
+		for ( const auto &path : paths ) {
+			probes.push_back( std::async( std::launch::async, probeMedia, ofToDataPath( path ), m_settings.ffprobePath ) );
+		}
+		for ( auto &probe : probes ) {
+			infos.push_back( probe.get() );
+		}
+	}
+
+	for ( size_t i = 0; i < paths.size(); ++i ) {
+		auto stream  = std::make_unique<Stream>();
+		stream->info = infos[i];
+		if ( !stream->info.isValid() ) {
+			LOG_ERROR() << "Unable to load " << paths[i];
+			close();
+			return false;
+		}
+
+		const MediaInfo &info = stream->info;
+		stream->pixels.allocate( info.width, info.height, m_settings.pixelFormat );
+		stream->pixels.set( 0 );
+		stream->ring.resize( std::max<size_t>( 1, m_settings.decodeAhead ) );
+		for ( auto &frame : stream->ring ) {
+			frame.pixels.allocate( info.width, info.height, m_settings.pixelFormat );
+		}
+		m_streams.push_back( std::move( stream ) );
+	}
+
+	m_nSets        = 0;
+	m_nPartialSets = 0;
+	setTime( 0.f );
+
+	LOG_VERBOSE() << "Loaded " << m_streams.size() << " streams";
+	return !m_streams.empty();
+}
+
+// -----------------------------------------------------------------
+void SyncPlayer::close()
+{
+	stopWorkers();
+	m_streams.clear();
+	m_time        = 0.;
+	m_isPlaying   = false;
+	m_isPaused    = false;
+	m_isFrameNew  = false;
+	m_isMovieDone = false;
+	m_isHolding   = false;
+}
+
+// -----------------------------------------------------------------
+void SyncPlayer::update()
+{
+	m_isFrameNew = false;
+	if ( m_streams.empty() ) return;
+
+	const TimePoint now = Clock::now();
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	if ( isPlaying() && !m_isMovieDone ) {
+		m_time += Seconds( now - m_lastUpdateTime ).count() * m_speed;
+	}
+	m_lastUpdateTime = now;
+
+	// frames the clock has passed are dropped but for the newest, a late stream's fallback, and the set is complete once
+	// every stream has its due frame - a stream that has ended holds its last one
+	size_t nLate = 0;
+	bool isDone  = true;
+	for ( auto &stream : m_streams ) {
+		const int64_t due = getDueIndex( *stream );
+		while ( stream->size > 1 && stream->ring[( stream->head + 1 ) % stream->ring.size()].index <= due ) {
+			stream->head = ( stream->head + 1 ) % stream->ring.size();
+			--stream->size;
+			++stream->nSkipped;
+		}
+
+		const bool hasDue = stream->shown == due || ( stream->size > 0 && stream->ring[stream->head].index == due );
+		if ( !hasDue && !stream->isDone ) ++nLate;
+		isDone = isDone && stream->isDone && stream->size == 0;
+
+		const float lag = ( due - ( stream->nextIndex - 1 ) ) / stream->info.fps;
+		stream->maxLag  = std::max( stream->maxLag, lag );
+
+		// skipping decoded frames can't catch up with the clock, ffmpeg still decodes them all - it's restarted there instead
+		// it starts as far ahead as the clock got during its last restart, so it doesn't start out behind again
+		const bool isRestarting = stream->seekIndex >= 0 || stream->seekClock >= 0.;
+		if ( m_settings.maxLag > 0.f && lag > m_settings.maxLag && !isRestarting && !stream->isDone && isPlaying() ) {
+			stream->seekIndex = due + int64_t( std::ceil( stream->seekLead * stream->info.fps ) );
+			if ( stream->isBusy ) killProcess( stream->pid );  // unblocks the worker reading from it
+			++stream->nSeeks;
+		}
+	}
+	m_condition.notify_all();
+
+	// wait for the late streams, for a while
+	if ( nLate > 0 ) {
+		if ( !m_isHolding ) m_holdBegin = now;
+		m_isHolding = true;
+		if ( Seconds( now - m_holdBegin ).count() < m_settings.maxHoldTime ) return;
+	} else {
+		m_isHolding = false;
+	}
+
+	std::vector<Stream *> held;
+	for ( auto &stream : m_streams ) {
+		const int64_t due = getDueIndex( *stream );
+		const bool isLate = stream->size > 0 && stream->ring[stream->head].index < due;
+		if ( isLate || ( stream->size > 0 && stream->ring[stream->head].index == due ) ) {
+			stream->pixels.swap( stream->ring[stream->head].pixels );
+			stream->shown = stream->ring[stream->head].index;
+			stream->head  = ( stream->head + 1 ) % stream->ring.size();
+			--stream->size;
+			m_isFrameNew = true;
+		}
+		if ( stream->shown != due && !stream->isDone ) {
+			held.push_back( stream.get() );
+		}
+	}
+
+	if ( m_isFrameNew ) {
+		++( held.empty() ? m_nSets : m_nPartialSets );
+		for ( auto stream : held ) {
+			++stream->nHeld;
+		}
+	}
+	m_isMovieDone = isDone;
+}
+
+// -----------------------------------------------------------------
+void SyncPlayer::play()
+{
+	if ( !isLoaded() ) return;
+	if ( m_isMovieDone ) setTime( 0.f );
+
+	m_isPlaying      = true;
+	m_isPaused       = false;
+	m_lastUpdateTime = Clock::now();
+}
+
+// -----------------------------------------------------------------
+void SyncPlayer::stop()
+{
+	m_isPlaying = false;
+	m_isPaused  = false;
+	if ( isLoaded() ) setTime( 0.f );
+}
+
+// -----------------------------------------------------------------
+void SyncPlayer::setPaused( bool isPaused )
+{
+	if ( m_isPaused && !isPaused ) {
+		m_lastUpdateTime = Clock::now();  // the time spent paused doesn't count
+	}
+	m_isPaused = isPaused;
+}
+
+// -----------------------------------------------------------------
+void SyncPlayer::setSpeed( float speed )
+{
+	if ( speed < 0.f ) {
+		LOG_WARNING() << "Reverse playback isn't supported";
+		speed = 0.f;
+	}
+	m_speed = speed;
+}
+
+// -----------------------------------------------------------------
+void SyncPlayer::setTime( float seconds )
+{
+	stopWorkers();
+
+	m_time        = std::max( 0.f, seconds );
+	m_isMovieDone = false;
+	m_isHolding   = false;
+	for ( auto &stream : m_streams ) {
+		const int64_t due  = getDueIndex( *stream );
+		const int nFrames  = stream->info.numFrames;
+		stream->nextIndex  = due;
+		stream->startFrame = int( m_settings.isLooping && nFrames > 0 ? due % nFrames : due );
+		stream->isDone     = false;
+	}
+
+	startWorkers();
+}
+
+// -----------------------------------------------------------------
+int SyncPlayer::getCurrentFrame( size_t stream ) const
+{
+	const int64_t shown = std::max<int64_t>( 0, m_streams[stream]->shown );
+	const int nFrames   = m_streams[stream]->info.numFrames;
+	return int( nFrames > 0 ? shown % nFrames : shown );
+}
+
+// -----------------------------------------------------------------
+SyncPlayerStats SyncPlayer::getStats() const
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	SyncPlayerStats stats;
+	stats.sets        = m_nSets;
+	stats.partialSets = m_nPartialSets;
+	for ( const auto &stream : m_streams ) {
+		SyncStreamStats streamStats;
+		streamStats.framesDecoded  = stream->nDecoded.load();
+		streamStats.framesSkipped  = stream->nSkipped.load();
+		streamStats.framesHeld     = stream->nHeld.load();
+		streamStats.seeks          = stream->nSeeks.load();
+		streamStats.lag            = ( getDueIndex( *stream ) - ( stream->nextIndex - 1 ) ) / stream->info.fps;
+		streamStats.maxLag         = stream->maxLag;
+		streamStats.bufferedFrames = stream->size;
+		stats.streams.push_back( streamStats );
+	}
+	return stats;
+}
+
+// -----------------------------------------------------------------
+void SyncPlayer::startWorkers()
+{
+	// reads block until ffmpeg has decoded, more workers than cores would only wait on each other's ffmpeg
+	const size_t n = std::min( m_streams.size(), std::max<size_t>( 1, m_settings.threads > 0 ? m_settings.threads : std::thread::hardware_concurrency() ) );
+
+	m_isRunning = true;
+	for ( size_t i = 0; i < n; ++i ) {
+		m_workers.emplace_back( &SyncPlayer::processWorker, this );
+	}
+}
+
+// -----------------------------------------------------------------
+void SyncPlayer::stopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_isRunning = false;
+		for ( auto &stream : m_streams ) {
+			killProcess( stream->pid );  // unblocks a worker reading from it
+		}
+		m_condition.notify_all();
+	}
+
+	for ( auto &worker : m_workers ) {
+		worker.join();
+	}
+	m_workers.clear();
+
+	for ( auto &stream : m_streams ) {
+		if ( stream->pipe ) closeProcess( stream->pipe, stream->pid );
+		stream->pipe      = nullptr;
+		stream->pid       = -1;
+		stream->head      = 0;
+		stream->size      = 0;
+		stream->seekIndex = -1;
+		stream->seekClock = -1.;
+	}
+}
+
+// -----------------------------------------------------------------
+int64_t SyncPlayer::getDueIndex( const Stream &stream ) const
+{
+	return int64_t( std::floor( m_time * stream.info.fps ) );
+}
+
+// -----------------------------------------------------------------
+SyncPlayer::Stream *SyncPlayer::getNextStream( std::vector<int> &pending )
+{
+	// the stream furthest behind the clock, or least ahead of it - of those with a frame to read, as a worker reading from
+	// an ffmpeg that's still decoding would leave the other streams waiting
+	Stream *next      = nullptr;
+	int64_t nextAhead = 0;
+	pending.clear();
+	for ( auto &stream : m_streams ) {
+		if ( stream->isBusy || stream->isDone ) continue;
+
+		if ( stream->size == stream->ring.size() ) continue;  // update() makes room
+
+		if ( stream->pipe && stream->seekIndex < 0 && !hasOutput( stream->pipe ) ) {
+			pending.push_back( fileno( stream->pipe ) );
+			continue;
+		}
+
+		const int64_t ahead = stream->nextIndex - getDueIndex( *stream );
+
+		if ( !next || ahead < nextAhead ) {
+			next      = stream.get();
+			nextAhead = ahead;
+		}
+	}
+	return next;
+}
+
+// -----------------------------------------------------------------
+void SyncPlayer::processWorker()
+{
+	std::vector<int> pending;
+	std::unique_lock<std::mutex> lock( m_mutex );
+	while ( m_isRunning ) {
+		Stream *stream = getNextStream( pending );
+		if ( !stream && pending.empty() ) {
+			m_condition.wait( lock );
+			continue;
+		}
+		if ( !stream ) {
+			// a pipe closed meanwhile only ends the wait early, and update() making room is noticed at the next timeout
+			lock.unlock();
+			waitForOutput( pending, 0.01f );
+			lock.lock();
+			continue;
+		}
+
+		// a lagging stream's ffmpeg is replaced by one starting at the clock, the frames decoded so far are dropped by update()
+		FILE *seekedPipe = nullptr;
+		int seekedPid    = -1;
+		if ( stream->seekIndex >= 0 ) {
+			const int nFrames  = stream->info.numFrames;
+			seekedPipe         = stream->pipe;
+			seekedPid          = stream->pid;
+			stream->pipe       = nullptr;
+			stream->pid        = -1;
+			stream->nextIndex  = stream->seekIndex;
+			stream->seekClock  = m_time;
+			stream->startFrame = int( m_settings.isLooping && nFrames > 0 ? stream->seekIndex % nFrames : stream->seekIndex );
+			stream->seekIndex  = -1;
+		}
+
+		// the worker owns the stream's pipe until it's done, and the free slot stays free while update() takes frames
+		// from the front
+		DecodedFrame &slot     = stream->ring[( stream->head + stream->size ) % stream->ring.size()];
+		const int startFrame   = stream->startFrame;
+		const bool isSpawning  = !stream->pipe;
+		const size_t frameSize = size_t( stream->info.width ) * stream->info.height * ( m_settings.pixelFormat == OF_PIXELS_RGBA ? 4 : 3 );
+		stream->isBusy         = true;
+		lock.unlock();
+
+		if ( seekedPipe ) {
+			killProcess( seekedPid );
+			closeProcess( seekedPipe, seekedPid );
+		}
+
+		if ( isSpawning ) {
+			const std::string cmd = getDecoderCommand( *stream, startFrame );
+			LOG_VERBOSE() << "Starting ffmpeg with command...\n\t" << cmd << "\n";
+
+			int pid    = -1;
+			FILE *pipe = openProcess( cmd, pid, ProcessPipe::Stdout );
+
+			lock.lock();
+			stream->pipe      = pipe;
+			stream->pid       = pid;
+			stream->hasFrames = false;
+			if ( !m_isRunning ) killProcess( pid );  // stopWorkers() came first
+
+			// seeking can take ffmpeg a while, its first frame is read once it's there
+			if ( pipe ) {
+				stream->isBusy = false;
+				m_condition.notify_all();
+				continue;
+			}
+			lock.unlock();
+		}
+
+		if ( slot.pixels.getTotalBytes() != frameSize ) {
+			slot.pixels.allocate( stream->info.width, stream->info.height, m_settings.pixelFormat );
+		}
+		const bool isRead = stream->pipe && readProcess( stream->pipe, slot.pixels.getData(), frameSize ) == frameSize;
+
+		lock.lock();
+		if ( isRead ) {
+			slot.index = stream->nextIndex++;
+			++stream->size;
+			++stream->nDecoded;
+			stream->hasFrames = true;
+			if ( stream->seekClock >= 0. ) {
+				stream->seekLead  = float( m_time - stream->seekClock );  // how far the clock got while ffmpeg restarted
+				stream->seekClock = -1.;
+			}
+		} else if ( m_isRunning && stream->seekIndex < 0 ) {
+			// the end of the file, unless update() killed ffmpeg to restart it, which the next pass does - ffmpeg is closed
+			// without the lock, nothing else touches the pipe while it's busy
+			FILE *pipe = stream->pipe;
+			const int pid = stream->pid;
+			stream->pipe  = nullptr;
+			stream->pid   = -1;
+			lock.unlock();
+			if ( pipe ) {
+				closeProcess( pipe, pid );
+			} else {
+				LOG_ERROR() << "Unable to start ffmpeg for " << stream->info.path;
+			}
+			lock.lock();
+
+			// an ffmpeg that started at the first frame and ended without one would do so again
+			const bool isEmpty = !stream->hasFrames && startFrame == 0;
+			stream->startFrame = 0;
+			stream->isDone     = !pipe || !m_settings.isLooping || isEmpty;
+		}
+		stream->isBusy = false;
+		m_condition.notify_all();
+	}
+}
+
+// -----------------------------------------------------------------
+std::string SyncPlayer::getDecoderCommand( const Stream &stream, int frame ) const
+{
+	DecoderArgs decoder;
+	decoder.path        = stream.info.path;
+	decoder.seekTime    = frame > 0 ? ( frame - 0.5 ) / stream.info.fps : 0.;  // half a frame early, so rounding can't skip frame
+	decoder.pixelFormat = m_settings.pixelFormat;
+	decoder.inputArgs   = m_settings.extraInputArgs;
+	decoder.outputArgs  = m_settings.extraOutputArgs;
+	return ofxFFmpeg::getDecoderCommand( m_settings.ffmpegPath, decoder );
+}
+
+}  // namespace ofxFFmpeg
@@ -0,0 +1,134 @@
+#pragma once
+#include "ofxFFmpegHelpers.h"
+#include "ofxFFmpegProbe.h"
+
+namespace ofxFFmpeg {
+
+struct SyncPlayerSettings
+{
+	std::string ffmpegPath      = "ffmpeg";
+	std::string ffprobePath     = "ffprobe";
+	ofPixelFormat pixelFormat   = OF_PIXELS_RGB;  // OF_PIXELS_RGB or OF_PIXELS_RGBA
+	size_t decodeAhead          = 4;     // frames buffered per stream, allocated by load()
+	size_t threads              = 0;     // workers shared by all the streams' ffmpeg, 0 for one per core (at most one per stream)
+	float maxHoldTime           = 0.1f;  // seconds a set waits for late streams before it's shown without them
+	float maxLag                = 0.5f;  // seconds a stream may fall behind before its ffmpeg restarts at the clock, 0 never
+	bool isLooping              = true;  // each stream loops on its own length
+	std::string extraInputArgs  = "";    // e.g. -hwaccel auto
+	std::string extraOutputArgs = "";    // e.g. -vf scale=640:-2 (the frame size is probed from the file, keep it)
+	std::shared_ptr<ProbeCache> probeCache = nullptr;  // load() skips ffprobe for files probed before, can be shared with players
+};
+
+struct SyncStreamStats
+{
+	uint64_t framesDecoded = 0;
+	uint64_t framesSkipped = 0;    // decoded after the clock had passed them, never shown
+	uint64_t framesHeld    = 0;    // sets shown without this stream's frame, it kept the previous one
+	uint64_t seeks         = 0;    // ffmpeg restarts at the clock, after lagging by maxLag
+	float lag              = 0.f;  // seconds the newest decoded frame is behind the clock, negative when it's ahead
+	float maxLag           = 0.f;
+	size_t bufferedFrames  = 0;
+};
+
+struct SyncPlayerStats
+{
+	uint64_t sets        = 0;  // shown with every stream on the clock's frame
+	uint64_t partialSets = 0;  // shown after maxHoldTime without the late streams
+	std::vector<SyncStreamStats> streams;
+};
+
+/**
+ * SyncPlayer plays several files in lockstep, e.g. for video walls. One master clock gives each stream its due frame,
+ * and update() only shows a set once every stream has decoded it - streams that fall behind skip the frames the clock
+ * has passed, and streams ahead hold theirs. After maxHoldTime the set is shown anyway, with the late streams on their
+ * newest frame. A stream that decodes slower than the clock only falls further behind, so once it lags by maxLag its
+ * ffmpeg restarts at the clock's frame. A pool of worker threads reads from all the streams' ffmpeg processes, always
+ * serving the stream that is furthest behind.
+ */
+class SyncPlayer
+{
+public:
+	~SyncPlayer();
+
+	void setup( const SyncPlayerSettings& settings );  // call before load()
+	bool load( const std::vector<std::string>& paths );  // fails if any file can't be loaded
+	void close();
+	void update();
+
+	void play();
+	void stop();  // stops and rewinds
+	void setPaused( bool isPaused );
+	void setSpeed( float speed );  // forward only
+	void setTime( float seconds );  // restarts every stream's ffmpeg there
+	float getTime() const { return float( m_time ); }  // the master clock
+
+	bool isLoaded() const { return !m_streams.empty(); }
+	bool isPlaying() const { return m_isPlaying && !m_isPaused; }
+	bool isPaused() const { return m_isPaused; }
+	bool isFrameNew() const { return m_isFrameNew; }
+	bool getIsMovieDone() const { return m_isMovieDone; }  // every stream ended, without looping
+
+	size_t getNumStreams() const { return m_streams.size(); }
+	ofPixels& getPixels( size_t stream ) { return m_streams[stream]->pixels; }
+	const ofPixels& getPixels( size_t stream ) const { return m_streams[stream]->pixels; }
+	const MediaInfo& getMediaInfo( size_t stream ) const { return m_streams[stream]->info; }
+	int getCurrentFrame( size_t stream ) const;
+
+	SyncPlayerStats getStats() const;
+
+protected:
+	struct DecodedFrame
+	{
+		ofPixels pixels;
+		int64_t index = 0;  // counted on across loops, so it's comparable to the clock
+	};
+
+	struct Stream
+	{
+		MediaInfo info;
+		ofPixels pixels;   // the displayed frame
+		int64_t shown = -1;  // its index
+
+		// guarded by m_mutex, except where a worker owns the stream
+		std::vector<DecodedFrame> ring;
+		size_t head = 0, size = 0;
+		int64_t nextIndex = 0;    // of the next frame ffmpeg writes
+		int64_t seekIndex = -1;   // where ffmpeg restarts once a worker gets to it, set by update() when the stream lags
+		double seekClock  = -1.;  // the clock when ffmpeg restarted, until its first frame
+		float seekLead    = 0.f;  // seconds of clock the last restart took
+		int startFrame    = 0;    // where the next ffmpeg starts
+		bool isBusy       = false;  // a worker is reading - it owns pipe and pid meanwhile
+		bool isDone       = false;  // ended without looping
+		bool hasFrames    = false;  // the running ffmpeg has written one
+		FILE* pipe        = nullptr;
+		int pid           = -1;
+
+		std::atomic<uint64_t> nDecoded { 0 }, nSkipped { 0 }, nHeld { 0 }, nSeeks { 0 };
+		float maxLag = 0.f;
+	};
+
+	SyncPlayerSettings m_settings;
+	std::vector<std::unique_ptr<Stream>> m_streams;
+	std::vector<std::thread> m_workers;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_isRunning = false;  // guarded by m_mutex
+
+	// master clock, written by the update() thread under m_mutex
+	double m_time = 0.;
+	float m_speed = 1.f;
+	TimePoint m_lastUpdateTime;
+	bool m_isPlaying = false, m_isPaused = false, m_isFrameNew = false, m_isMovieDone = false;
+	bool m_isHolding = false;  // a set is waiting for late streams since m_holdBegin
+	TimePoint m_holdBegin;
+	uint64_t m_nSets = 0, m_nPartialSets = 0;
+
+	void startWorkers();
+	void stopWorkers();  // also closes every stream's ffmpeg and clears the rings
+	void processWorker();
+	Stream* getNextStream( std::vector<int>& pending );  // the one a worker should read from, needs the lock - pending gets the fds still decoding
+	int64_t getDueIndex( const Stream& stream ) const;  // the frame the clock is on, needs the lock
+	std::string getDecoderCommand( const Stream& stream, int frame ) const;
+};
+
+}  // namespace ofxFFmpeg
@@ -0,0 +1,136 @@
+#include "ofxFFmpegThumbnails.h"
+#include "ofxFFmpegProbe.h"
+#include "ofxFFmpegProcess.h"
+// openFrameworks
+#include "ofLog.h"
+#include "ofUtils.h"
+
+// Logging macros
+#define LOG_ERROR() ofLogError( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+#define LOG_WARNING() ofLogWarning( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+#define LOG_VERBOSE() ofLogVerbose( "ofxFFmpeg" ) << __FUNCTION__ << ": "
+
+namespace ofxFFmpeg {
+
+namespace {
+
+	std::string getThumbnailCommand( const std::string &path, float time, int width, int height, const ThumbnailSettings &settings )
+	{
+		DecoderArgs decoder;
+		decoder.path           = path;
+		decoder.seekTime       = time;
+		decoder.isAccurateSeek = !settings.keyframesOnly;  // stop at the keyframe instead of decoding on from it
+		decoder.nFrames        = 1;
+		decoder.filter         = "scale=" + std::to_string( width ) + ":" + std::to_string( height ) + ":flags=fast_bilinear";
+		decoder.pixelFormat    = settings.pixelFormat;
+		decoder.inputArgs      = ( settings.keyframesOnly ? "-skip_frame nokey " : "" ) + settings.extraInputArgs;  // the decoder drops everything else
+		return getDecoderCommand( settings.ffmpegPath, decoder );
+	}
+
+	std::vector<ofPixels> decodeThumbnails( const MediaInfo &info, const std::vector<float> &times, const ThumbnailSettings &settings )
+	{
+		std::vector<ofPixels> thumbnails( times.size() );
+		if ( times.empty() ) return thumbnails;
+
+		const int width        = std::max( 1, settings.width > 0 ? settings.width : int( std::round( float( settings.height ) * info.width / info.height ) ) );
+		const int height       = std::max( 1, settings.height > 0 ? settings.height : int( std::round( float( width ) * info.height / info.width ) ) );
+		const size_t frameSize = size_t( width ) * height * ( settings.pixelFormat == OF_PIXELS_RGBA ? 4 : 3 );
+
+		// each worker runs one ffmpeg at a time and takes the next time when it's done, so slow seeks don't hold up the rest
+		std::atomic<size_t> next { 0 };
+		auto process = [&] {
+			for ( size_t i = next++; i < times.size(); i = next++ ) {
+				const std::string cmd = getThumbnailCommand( info.path, std::max( 0.f, times[i] ), width, height, settings );
+				LOG_VERBOSE() << "Starting ffmpeg with command...\n\t" << cmd << "\n";
+
+				int pid    = -1;
+				FILE *pipe = openProcess( cmd, pid, ProcessPipe::Stdout );
+				if ( !pipe ) {
+					LOG_ERROR() << "Unable to start ffmpeg for " << info.path;
+					continue;
+				}
+
+				ofPixels pixels;
+				pixels.allocate( width, height, settings.pixelFormat );
+				if ( readProcess( pipe, pixels.getData(), frameSize ) == frameSize ) {
+					thumbnails[i] = std::move( pixels );
+				} else {
+					LOG_WARNING() << "No frame at " << times[i] << "s in " << info.path;
+				}
+				closeProcess( pipe, pid );
+			}
+		};
+
+		const size_t nThreads = std::min( times.size(), std::max<size_t>( 1, settings.threads > 0 ? settings.threads : std::thread::hardware_concurrency() ) );
+		std::vector<std::thread> threads;
+		for ( size_t i = 1; i < nThreads; ++i ) {
+			threads.emplace_back( process );
+		}
+		process();
+		for ( auto &thread : threads ) {
+			thread.join();
+		}
+
+		return thumbnails;
+	}
+}  // namespace
+
+// -----------------------------------------------------------------
+std::vector<ofPixels> getThumbnails( const std::string &path, const std::vector<float> &times, const ThumbnailSettings &settings )
+{
+	const MediaInfo info = probeMedia( ofToDataPath( path ), settings.ffprobePath );
+	if ( !info.isValid() ) {
+		LOG_ERROR() << "Unable to load " << path;
+		return std::vector<ofPixels>( times.size() );
+	}
+	return decodeThumbnails( info, times, settings );
+}
+
+// -----------------------------------------------------------------
+std::vector<ofPixels> getThumbnails( const std::string &path, size_t count, const ThumbnailSettings &settings )
+{
+	const MediaInfo info = probeMedia( ofToDataPath( path ), settings.ffprobePath );
+	if ( !info.isValid() ) {
+		LOG_ERROR() << "Unable to load " << path;
+		return std::vector<ofPixels>( count );
+	}
+
+	std::vector<float> times( count );
+	for ( size_t i = 0; i < count; ++i ) {
+		times[i] = ( i + 0.5f ) * info.duration / count;
+	}
+	return decodeThumbnails( info, times, settings );
+}
+
+// -----------------------------------------------------------------
+ofPixels getContactSheet( const std::vector<ofPixels> &thumbnails, size_t columns, size_t spacing )
+{
+	ofPixels sheet;
+
+	// sized by the first thumbnail that decoded
+	const auto first = std::find_if( thumbnails.begin(), thumbnails.end(), []( const ofPixels &pixels ) { return pixels.isAllocated(); } );
+	if ( first == thumbnails.end() || columns == 0 ) return sheet;
+
+	const size_t width = first->getWidth(), height = first->getHeight();
+	const size_t rows  = ( thumbnails.size() + columns - 1 ) / columns;
+	columns            = std::min( columns, thumbnails.size() );
+
+	sheet.allocate( columns * width + ( columns + 1 ) * spacing, rows * height + ( rows + 1 ) * spacing, first->getPixelFormat() );
+	sheet.set( 0 );
+
+	const size_t channels = sheet.getNumChannels();
+	for ( size_t i = 0; i < thumbnails.size(); ++i ) {
+		const ofPixels &thumbnail = thumbnails[i];
+		if ( thumbnail.getWidth() != width || thumbnail.getHeight() != height || thumbnail.getNumChannels() != channels ) continue;
+
+		const size_t x = spacing + ( i % columns ) * ( width + spacing );
+		const size_t y = spacing + ( i / columns ) * ( height + spacing );
+		for ( size_t row = 0; row < height; ++row ) {
+			std::memcpy( sheet.getData() + ( ( y + row ) * sheet.getWidth() + x ) * channels, thumbnail.getData() + row * width * channels, width * channels );
+		}
+	}
+
+	return sheet;
+}
+
+}  // namespace ofxFFmpeg
@@ -0,0 +1,29 @@
+#pragma once
+#include "ofxFFmpegHelpers.h"
+
+namespace ofxFFmpeg {
+
+struct ThumbnailSettings
+{
+	std::string ffmpegPath     = "ffmpeg";
+	std::string ffprobePath    = "ffprobe";
+	int width                  = 160;  // the height follows the aspect ratio when it's 0
+	int height                 = 0;
+	ofPixelFormat pixelFormat  = OF_PIXELS_RGB;  // OF_PIXELS_RGB or OF_PIXELS_RGBA
+	size_t threads             = 0;     // ffmpeg processes running at once, 0 for one per core
+	bool keyframesOnly         = true;  // the keyframe at or before each time - only keyframes are decoded, which is much faster
+	std::string extraInputArgs = "";    // e.g. -hwaccel auto
+};
+
+// decodes a thumbnail at each time (seconds), splitting them across settings.threads ffmpeg processes. Blocks until
+// all are done - ones that failed are left unallocated
+std::vector<ofPixels> getThumbnails( const std::string& path, const std::vector<float>& times, const ThumbnailSettings& settings = ThumbnailSettings() );
+
+// count thumbnails spread evenly over the file, each from the middle of its part
+std::vector<ofPixels> getThumbnails( const std::string& path, size_t count, const ThumbnailSettings& settings = ThumbnailSettings() );
+
+// tiles thumbnails of the same size left to right and top to bottom, spacing pixels apart on black - to write it as
+// one image: ofSaveImage( getContactSheet( getThumbnails( path, 100 ), 10 ), "sheet.jpg" )
+ofPixels getContactSheet( const std::vector<ofPixels>& thumbnails, size_t columns, size_t spacing = 0 );
+
+}  // namespace ofxFFmpeg
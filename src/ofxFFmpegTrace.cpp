@@ -0,0 +1,193 @@
+#include "ofxFFmpegTrace.h"
+// openFrameworks
+#include "ofLog.h"
+
+#include <algorithm>
+
+namespace ofxFFmpeg {
+
+namespace {
+
+	std::atomic<uint64_t> nextTracerId { 1 };
+
+	const char *getEventName( TraceEvent event )
+	{
+		switch ( event ) {
+			case TraceEvent::Submit: return "submit";
+			case TraceEvent::CopyDone: return "copied";
+			case TraceEvent::Queued: return "queued";
+			case TraceEvent::Dequeued: return "dequeued";
+			case TraceEvent::WriteBegin:
+			case TraceEvent::WriteEnd: return "write";
+		}
+		return "";
+	}
+
+	const char *getEventPhase( TraceEvent event )
+	{
+		switch ( event ) {
+			case TraceEvent::WriteBegin: return "B";  // slice begin
+			case TraceEvent::WriteEnd: return "E";    // slice end
+			default: return "i";                      // instant
+		}
+	}
+}  // namespace
+
+// -----------------------------------------------------------------
+// Releases the thread's buffers when it exits. Buffers are only weakly referenced, so a tracer destroyed before the
+// thread takes its buffers with it, and its entry is dropped by the thread's next lookup.
+struct Tracer::ThreadCache
+{
+	struct Entry
+	{
+		uint64_t tracerId;
+		ThreadBuffer *buffer;  // valid while the tracer is, which it is when its own record() looks it up
+		std::weak_ptr<ThreadBuffer> owner;
+	};
+	std::vector<Entry> entries;
+
+	~ThreadCache()
+	{
+		for ( const auto &entry : entries ) {
+			if ( auto buffer = entry.owner.lock() ) buffer->isOwned.store( false, std::memory_order_release );
+		}
+	}
+};
+
+// -----------------------------------------------------------------
+Tracer::Tracer( size_t maxEventsPerThread )
+    : m_id( nextTracerId++ )
+    , m_maxEventsPerThread( maxEventsPerThread )
+    , m_epoch( Clock::now() )
+{
+}
+
+// -----------------------------------------------------------------
+void Tracer::setEnabled( bool enabled )
+{
+	m_isEnabled = enabled;
+}
+
+// -----------------------------------------------------------------
+void Tracer::recordEvent( TraceEvent event, uint64_t frame )
+{
+	ThreadBuffer *buffer = getThreadBuffer();
+	const size_t count   = buffer->count.load( std::memory_order_relaxed );
+
+	buffer->events[count % buffer->events.size()] = { Clock::now(), frame, buffer->tid, event };
+	buffer->count.store( count + 1, std::memory_order_release );
+}
+
+// -----------------------------------------------------------------
+Tracer::ThreadBuffer *Tracer::getThreadBuffer()
+{
+	// each thread caches its buffer per tracer, so the lock is only taken on a thread's first event
+	thread_local ThreadCache cache;
+
+	for ( const auto &entry : cache.entries ) {
+		if ( entry.tracerId == m_id ) return entry.buffer;
+	}
+
+	// forget tracers that have been destroyed since
+	auto &entries = cache.entries;
+	entries.erase( std::remove_if( entries.begin(), entries.end(), []( const ThreadCache::Entry &entry ) { return entry.owner.expired(); } ), entries.end() );
+
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	// continue the buffer of a thread that has exited, it keeps the events recorded so far - on the old thread's track
+	std::shared_ptr<ThreadBuffer> buffer;
+	for ( const auto &released : m_buffers ) {
+		if ( !released->isOwned.load( std::memory_order_acquire ) ) {
+			buffer = released;
+			break;
+		}
+	}
+
+	if ( !buffer ) {
+		buffer = std::make_shared<ThreadBuffer>();
+		buffer->events.resize( std::max<size_t>( 1, m_maxEventsPerThread ) );
+		m_buffers.push_back( buffer );
+	}
+
+	buffer->tid     = ++m_nThreads;
+	buffer->isOwned = true;
+	entries.push_back( { m_id, buffer.get(), buffer } );
+	return buffer.get();
+}
+
+// -----------------------------------------------------------------
+ofJson Tracer::toJson() const
+{
+	ofJson events = ofJson::array();
+
+	std::lock_guard<std::mutex> lock( m_mutex );
+	for ( const auto &buffer : m_buffers ) {
+		// the owner keeps recording meanwhile, so the ring is copied first and events overwritten during the copy are left out
+		const size_t size  = buffer->events.size();
+		const size_t count = buffer->count.load( std::memory_order_acquire );
+		const size_t first = count > size ? count - size : 0;
+
+		std::vector<Event> copied( count - first );
+		for ( size_t i = first; i < count; ++i ) {
+			copied[i - first] = buffer->events[i % size];
+		}
+		// the owner may be writing event writing by now, over event writing - size
+		std::atomic_thread_fence( std::memory_order_acquire );
+		const size_t writing = buffer->count.load( std::memory_order_relaxed );
+		const size_t valid   = writing + 1 > size ? writing + 1 - size : 0;
+
+		for ( size_t i = std::max( first, valid ); i < count; ++i ) {
+			const Event &e = copied[i - first];
+
+			const std::string phase = getEventPhase( e.type );
+
+			ofJson json;
+			json["name"] = getEventName( e.type );
+			json["ph"]   = phase;
+			json["cat"]  = "frame";
+			json["ts"]   = std::chrono::duration<double, std::micro>( e.time - m_epoch ).count();
+			json["pid"]  = 1;
+			json["tid"]  = e.tid;
+			json["args"] = { { "frame", e.frame } };
+			if ( phase == "i" ) json["s"] = "t";  // thread scoped instant
+
+			events.push_back( json );
+		}
+	}
+
+	return { { "traceEvents", events }, { "displayTimeUnit", "ms" } };
+}
+
+// -----------------------------------------------------------------
+bool Tracer::save( const std::string &path ) const
+{
+	if ( !ofSaveJson( path, toJson() ) ) {
+		ofLogError( "ofxFFmpeg" ) << __FUNCTION__ << ": Unable to save trace to " << path;
+		return false;
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------
+void Tracer::clear()
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	for ( auto &buffer : m_buffers ) {
+		buffer->count = 0;
+	}
+	m_epoch = Clock::now();
+}
+
+// -----------------------------------------------------------------
+size_t Tracer::getNumOverwrittenEvents() const
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	size_t nOverwritten = 0;
+	for ( const auto &buffer : m_buffers ) {
+		const size_t count = buffer->count.load( std::memory_order_relaxed );
+		nOverwritten += count > buffer->events.size() ? count - buffer->events.size() : 0;
+	}
+	return nOverwritten;
+}
+
+}  // namespace ofxFFmpeg
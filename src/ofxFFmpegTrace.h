@@ -0,0 +1,74 @@
+#pragma once
+#include "ofxFFmpegHelpers.h"
+
+namespace ofxFFmpeg {
+
+enum class TraceEvent : uint8_t
+{
+	Submit,      // addFrame() called
+	CopyDone,    // pixels copied for the queue
+	Queued,      // frame pushed to the queue
+	Dequeued,    // frame taken off the queue by the writer
+	WriteBegin,  // pipe write started
+	WriteEnd     // pipe write finished
+};
+
+/**
+ * Tracer records per-frame lifecycle events into preallocated per-thread rings, and dumps them as Chrome trace-event JSON
+ * (open in chrome://tracing or https://ui.perfetto.dev).
+ * Recording is lock-free; when disabled, record() costs a single relaxed atomic load.
+ * A full ring overwrites its oldest events, so a trace always ends with the latest ones - like a stutter late in a long
+ * recording. A buffer outlives its thread and is taken over by the next thread that records, under a new trace track,
+ * so memory only grows with the number of threads recording at once.
+ */
+class Tracer
+{
+public:
+	explicit Tracer( size_t maxEventsPerThread = 1 << 16 );
+
+	void setEnabled( bool enabled );
+	bool isEnabled() const { return m_isEnabled.load( std::memory_order_relaxed ); }
+
+	void record( TraceEvent event, uint64_t frame )
+	{
+		if ( isEnabled() ) recordEvent( event, frame );
+	}
+
+	ofJson toJson() const;
+	bool save( const std::string& path ) const;  // writes Chrome trace-event JSON
+	void clear();                                // not thread safe - call while nothing is being recorded
+
+	size_t getNumOverwrittenEvents() const;  // the oldest events, lost to newer ones in full rings
+
+protected:
+	struct Event
+	{
+		TimePoint time;
+		uint64_t frame;
+		uint32_t tid;  // a recycled buffer holds events of several threads
+		TraceEvent type;
+	};
+
+	struct ThreadBuffer
+	{
+		uint32_t tid;               // of the thread that owns it now
+		std::vector<Event> events;  // preallocated ring, written by the owning thread only
+		std::atomic<size_t> count { 0 };     // events ever recorded, event i is in events[i % size]
+		std::atomic<bool> isOwned { true };  // false once its thread has exited
+	};
+
+	struct ThreadCache;  // a thread's buffers, by tracer
+
+	const uint64_t m_id;  // unique per tracer, so thread-local lookups never hit a destroyed tracer
+	const size_t m_maxEventsPerThread;
+	TimePoint m_epoch;
+	std::atomic<bool> m_isEnabled { false };
+	mutable std::mutex m_mutex;  // guards m_buffers and m_nThreads, only taken the first time a thread records
+	std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+	uint32_t m_nThreads = 0;  // that have recorded, numbering their tracks
+
+	void recordEvent( TraceEvent event, uint64_t frame );
+	ThreadBuffer* getThreadBuffer();
+};
+
+}  // namespace ofxFFmpeg